@@ -15,17 +15,100 @@
 #include "vec.h"
 #ifdef GRO_V5
 #include "pargs.h"
+#include "trxio.h"
 #else
 #include "statutil.h"
 #endif
 
 #define FRAMESTEP 1000 // The number of new frames by which to reallocate an array of length # trajectory frames
 
-void read_traj(const char *traj_fname, rvec ***x, matrix **box, int *nframes, int *natoms, output_env_t *oenv);
+/* State for reading a trajectory one frame at a time (see open_traj_stream below).
+ * Only a single full frame is kept in memory, no matter how long the trajectory is.
+ */
+struct traj_stream {
+	t_trxstatus *status;
+	output_env_t *oenv;
+	rvec *frame; // Decode buffer for one full (unfiltered) frame
+	matrix box;
+	real t;
+	int natoms_full; // Number of atoms in each frame of the trajectory file
+	atom_id *indx; // Selected atom indexes of all groups one after the other, NULL if no index file was given
+	int ngroups; // Number of selected index groups (1 if no index file was given)
+	int *isize; // [ngroups] Number of atoms of each group, whose atoms come in this order in the returned frames
+	int natoms; // Number of atoms in each frame returned by read_traj_stream (the sum of isize)
+	int skip; // Only every skip-th frame is returned
+	int left; // Number of frames this process still returns, including a pending one (see set_traj_partition), -1 for all
+	gmx_bool pending; // TRUE if the frame in the decode buffer has not been returned yet
+	gmx_bool follow; // TRUE if read_traj_stream waits for frames that are still being written (see follow_traj_stream)
+	double wait; // Number of seconds that a followed stream waits for a new frame, <= 0 to wait forever
+	char *fname; // Name of the followed trajectory file, NULL if not following
+};
+
+void set_traj_partition(int part, int nparts);
+/* Makes every trajectory that is read by this process afterwards, with read_traj, read_traj_ndx or a traj_stream below,
+ * only give the part-th of nparts blocks of consecutive frames of the n frames it would give otherwise,
+ * the frames part * n / nparts up to (part + 1) * n / nparts, so that nparts processes, such as MPI ranks, 
+ * can split the frames of a trajectory between them. The default is part 0 of 1, which gives all frames.
+ * For an XTC file without -b, -e or -dt, the frames are found from their headers and only the frames of the block 
+ * are decoded. Otherwise, all frames are decoded once to count them and to find where the block starts,
+ * and the frames of the block are decoded again.
+ * Not for follow_traj_stream.
+ */
+
+void read_traj(const char *traj_fname, rvec ***x, matrix **box, int *nframes, int *natoms, output_env_t *oenv, int skip);
 /* Reads a trajectory file.
  * rvec **x is position coordinates indexed x[frame #][atom #].
  * matrix *box is a 1D array of matrices indexed [frame #]
  * 2D memory is allocated for x and 1D memory is allocated for box.
+ * Only every skip-th frame is kept (skip <= 1 keeps all frames), on top of any -b/-e/-dt selection in oenv. 
+ * Skipped frames are decoded into the buffer of the next kept frame, so no memory is allocated for them.
+ */
+
+void read_traj_ndx(const char *traj_fname, const char *ndx_fname, int ngroups, rvec ***x, matrix **box, int *nframes, 
+	int *natoms, int **isize, output_env_t *oenv, int skip);
+/* Same as read_traj, but if ndx_fname is not null, only the coordinates of the atoms in the first ngroups groups
+ * of the index file are stored, the atoms of each group after those of the group before (see open_traj_stream).
+ * natoms is set to the total number of stored atoms per frame. If isize is not null, 
+ * 1D memory is allocated for *isize and the number of atoms of each group is stored in it.
+ * Each frame is decoded into a single reusable full-frame buffer and only the selected atoms are copied out of it,
+ * so the unfiltered trajectory is never held in memory.
+ */
+
+void open_traj_stream(const char *traj_fname, const char *ndx_fname, int ngroups, output_env_t *oenv, int skip, 
+	struct traj_stream *stream);
+/* Opens a trajectory file for frame-by-frame reading.
+ * Only every skip-th frame is returned (skip <= 1 returns all frames), as in read_traj.
+ * If ndx_fname is not null, frames are filtered by the first ngroups groups in the index file as they are read:
+ * the returned frames hold the atoms of the first group, then those of the second group, and so on.
+ * An atom that is in several groups is returned once for each of them.
+ * stream->natoms is set to the number of atoms in each returned frame.
+ * Call close_traj_stream when done.
+ */
+
+void follow_traj_stream(const char *traj_fname, const char *ndx_fname, int ngroups, output_env_t *oenv, int skip, 
+	double wait, struct traj_stream *stream);
+/* Same as open_traj_stream, but for a trajectory that is still being written, such as the output of a running mdrun.
+ * Waits for the file to appear with its first frame, and then read_traj_stream waits for new frames at the end of the file
+ * instead of stopping there: a frame that is only partly written is read again from its start once the file has grown.
+ * The stream ends when nothing has been added to the file for wait seconds (wait <= 0 waits forever),
+ * or once stop_traj_streams is called.
+ * If traj_fname is a named pipe, its reads simply block until the writer sends the next frame, 
+ * and the stream ends when the writer closes the pipe.
+ * An error is raised if the first frame does not arrive in time.
+ */
+
+void stop_traj_streams();
+/* Makes every read_traj_stream and follow_traj_stream of this process return as if the trajectory had ended.
+ * Only sets a flag, so it can be called from a signal handler, ex. to end a followed stream on SIGINT.
+ */
+
+gmx_bool read_traj_stream(struct traj_stream *stream, rvec *x, matrix box);
+/* Reads the next frame of the stream into x (which must hold stream->natoms vectors) and box.
+ * Returns FALSE when there are no more frames.
+ */
+
+void close_traj_stream(struct traj_stream *stream);
+/* Closes the trajectory file and frees the memory of a stream.
  */
 
 void print_traj(rvec **x, int nframes, int natoms, const char *fname);
@@ -9,23 +9,227 @@
  * and including many others, as listed at http://www.gromacs.org.
  */
 
+#define _POSIX_C_SOURCE 200112L // nanosleep, stat, fseeko
+
 #include "gkut_io.h"
 
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #ifdef GRO_V5
 #include "index.h"
-#include "trxio.h"
+#include "timecontrol.h"
 #endif
+#include "gmx_fatal.h"
+#include "gmxfio.h"
 #include "smalloc.h"
 
-void read_traj(const char *traj_fname, rvec ***x, matrix **box, int *nframes, int *natoms, output_env_t *oenv) {
+#define FOLLOWPOLL 0.2 // Number of seconds between two checks for new frames of a followed trajectory
+#define FOLLOWSETTLE 0.05 // Number of seconds without growth after which the first frame of a followed trajectory is read
+#define XTC_MAGIC 1995 // First 4 bytes of each frame of an XTC file
+
+static int traj_part = 0, traj_nparts = 1; // see set_traj_partition
+static volatile sig_atomic_t traj_stop = 0; // see stop_traj_streams
+
+// Returns the size in bytes of a file, -1 if it does not exist
+static off_t file_size(const char *fname) {
+	struct stat st;
+	return stat(fname, &st) == 0 ? st.st_size : -1;
+}
+
+// Waits until a file is larger than size bytes, checking every FOLLOWPOLL seconds.
+// Returns FALSE if it did not grow for wait seconds (wait <= 0 waits forever) or the streams were stopped.
+static gmx_bool wait_growth(const char *fname, off_t size, double wait) {
+	struct timespec poll = {0, (long)(FOLLOWPOLL * 1e9)};
+	double idle = 0;
+
+	while(!traj_stop && (wait <= 0 || idle < wait)) {
+		if(file_size(fname) > size)
+			return TRUE;
+		nanosleep(&poll, NULL); // cut short by a signal, after which traj_stop is checked again
+		idle += FOLLOWPOLL;
+	}
+	return FALSE;
+}
+
+// Waits until a file is not empty and its size has not changed for FOLLOWSETTLE seconds,
+// so that its first frame has most likely been written completely, as a frame is usually written in one go.
+// Returns FALSE like wait_growth.
+static gmx_bool wait_settled(const char *fname, double wait) {
+	struct timespec settle = {0, (long)(FOLLOWSETTLE * 1e9)};
+	off_t size = 0;
+
+	while(wait_growth(fname, size, wait)) {
+		size = file_size(fname);
+		nanosleep(&settle, NULL);
+		if(file_size(fname) == size)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+// Reads the next frame to keep into x and box, decoding and dropping the skip - 1 frames before it.
+static gmx_bool read_next_kept(output_env_t oenv, t_trxstatus *status, real *t, int natoms, rvec *x, matrix box, int skip) {
+#ifdef GRO_V5
+	(void)natoms; // read_next_x of GROMACS 5 gets the number of atoms from status
+#endif
+	for(int i = 0; i < (skip > 1 ? skip : 1); ++i) {
+		if(!read_next_x(oenv, status, t,
+#ifndef GRO_V5
+			natoms,
+#endif
+			x, box))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+// Returns the next 4-byte big-endian (XDR) integer of a file in *val, FALSE at the end of the file.
+static gmx_bool read_xdr_int(FILE *fp, int *val) {
+	unsigned char b[4];
+	if(fread(b, 1, 4, fp) != 4)
+		return FALSE;
+	*val = (int)((unsigned int)b[0] << 24 | (unsigned int)b[1] << 16 | (unsigned int)b[2] << 8 | b[3]);
+	return TRUE;
+}
+
+// Finds the file offset of each complete frame of an XTC file from the frame headers alone, without decoding any coordinates.
+// Returns the number of frames with their offsets in *offsets, or -1 if the file is not an XTC file.
+static int index_xtc(const char *fname, gmx_off_t **offsets) {
+	FILE *fp = fopen(fname, "rb");
+	off_t size = file_size(fname);
+	int magic, natoms, nframes = 0, est_frames = FRAMESTEP;
+
+	if(fp == NULL)
+		return -1;
+	if(!read_xdr_int(fp, &magic) || magic != XTC_MAGIC) {
+		fclose(fp);
+		return -1;
+	}
+
+	snew(*offsets, est_frames);
+	for(off_t start = 0; fseeko(fp, start, SEEK_SET) == 0; ) {
+		int word, nbytes = 0;
+		off_t len;
+		if(!read_xdr_int(fp, &magic) || magic != XTC_MAGIC || !read_xdr_int(fp, &natoms))
+			break;
+		// step, time, box and the number of atoms again
+		for(int i = 0; i < 12; ++i) {
+			if(!read_xdr_int(fp, &word))
+				break;
+		}
+		// up to 9 atoms are stored as floats, more as precision, minint[3], maxint[3], smallidx and the number of bytes
+		if(natoms <= 9) {
+			len = 14 * 4 + natoms * 3 * 4;
+		}
+		else {
+			for(int i = 0; i < 9; ++i) {
+				if(!read_xdr_int(fp, &nbytes))
+					break;
+			}
+			len = 23 * 4 + (nbytes + 3) / 4 * 4;
+		}
+		if(nbytes < 0 || start + len > size) // the last frame is incomplete
+			break;
+
+		if(nframes >= est_frames) {
+			est_frames += FRAMESTEP;
+			srenew(*offsets, est_frames);
+		}
+		(*offsets)[nframes++] = start;
+		start += len;
+	}
+	fclose(fp);
+	return nframes;
+}
+
+// Reads the first frame that this process keeps (see set_traj_partition) into x and box, 
+// which already hold the first frame of the trajectory.
+// Returns the number of frames this process keeps, including this one, 0 if there is none, or -1 for all frames (one part).
+static int read_first_kept(const char *fname, output_env_t oenv, t_trxstatus *status, real *t, int natoms, 
+	rvec *x, matrix box, int skip) {
+	t_fileio *fio = trx_get_fileio(status);
+	gmx_off_t *offsets = NULL;
+	int nkept, first, last, n;
+
+	if(traj_nparts <= 1)
+		return -1;
+	skip = skip > 1 ? skip : 1;
+
+	if(!bTimeSet(TBEGIN) && !bTimeSet(TEND) && !bTimeSet(TDELTA) && (n = index_xtc(fname, &offsets)) >= 0) {
+		// every frame is read, so the kept frames are the frames 0, skip, 2 * skip, ... of the file
+		nkept = (n + skip - 1) / skip;
+		first = (int)((long)traj_part * nkept / traj_nparts);
+		last = (int)((long)(traj_part + 1) * nkept / traj_nparts);
+		if(first > 0 && first < last) {
+			gmx_fio_seek(fio, offsets[first * skip]);
+			read_next_kept(oenv, status, t, natoms, x, box, 1);
+		}
+	}
+	else {
+		// decode and drop all frames to count them, noting where the reads for each kept frame start
+		rvec *x0;
+		matrix box0;
+		real t0 = *t;
+		int est_frames = FRAMESTEP;
+
+		snew(x0, natoms);
+		memcpy(x0, x, natoms * sizeof(rvec));
+		copy_mat(box, box0);
+		snew(offsets, est_frames);
+		for(nkept = 1; ; ++nkept) {
+			if(nkept >= est_frames) {
+				est_frames += FRAMESTEP;
+				srenew(offsets, est_frames);
+			}
+			offsets[nkept] = gmx_fio_ftell(fio);
+			if(!read_next_kept(oenv, status, t, natoms, x, box, skip))
+				break;
+		}
+
+		first = (int)((long)traj_part * nkept / traj_nparts);
+		last = (int)((long)(traj_part + 1) * nkept / traj_nparts);
+		if(first == 0) {
+			memcpy(x, x0, natoms * sizeof(rvec));
+			copy_mat(box0, box);
+			*t = t0;
+			gmx_fio_seek(fio, offsets[1]);
+		}
+		else if(first < last) {
+			gmx_fio_seek(fio, offsets[first]);
+			read_next_kept(oenv, status, t, natoms, x, box, skip);
+		}
+		sfree(x0);
+	}
+	sfree(offsets);
+	return last - first;
+}
+
+void stop_traj_streams() {
+	traj_stop = 1;
+}
+
+void set_traj_partition(int part, int nparts) {
+	traj_nparts = nparts > 1 ? nparts : 1;
+	traj_part = part > 0 && part < traj_nparts ? part : 0;
+}
+
+void read_traj(const char *traj_fname, rvec ***x, matrix **box, int *nframes, int *natoms, output_env_t *oenv, int skip) {
 	t_trxstatus *status = NULL;
 	real t;
-	int est_frames = FRAMESTEP;
+	int est_frames = FRAMESTEP, nkept;
 	*nframes = 0;
 
 	snew(*x, est_frames);
 	snew(*box, est_frames);
 	*natoms = read_first_x(*oenv, &status, traj_fname, &t, &((*x)[0]), (*box)[0]);
+	nkept = read_first_kept(traj_fname, *oenv, status, &t, *natoms, (*x)[0], (*box)[0], skip);
+	if(nkept == 0) { // fewer frames than parts
+		sfree((*x)[0]);
+		close_trx(status);
+		return;
+	}
 
 	do {
 		++(*nframes);
@@ -35,16 +239,164 @@ void read_traj(const char *traj_fname, rvec ***x, matrix **box, int *nframes, in
 			srenew(*box, est_frames);
 		}
 		snew((*x)[*nframes], *natoms);
-	} while(read_next_x(*oenv, status, &t,
-#ifndef GRO_V5 
-		*natoms,
-#endif
-		(*x)[*nframes], (*box)[*nframes]));
+	} while(*nframes != nkept && read_next_kept(*oenv, status, &t, *natoms, (*x)[*nframes], (*box)[*nframes], skip));
 
 	sfree((*x)[*nframes]); // Nothing was read to the last allocated frame
 	close_trx(status);
 }
 
+void read_traj_ndx(const char *traj_fname, const char *ndx_fname, int ngroups, rvec ***x, matrix **box, int *nframes, 
+	int *natoms, int **isize, output_env_t *oenv, int skip) {
+	struct traj_stream stream;
+	int est_frames = FRAMESTEP;
+
+	if(ndx_fname == NULL) { // nothing to filter, so decode straight into the stored frames
+		read_traj(traj_fname, x, box, nframes, natoms, oenv, skip);
+		if(isize) {
+			snew(*isize, 1);
+			(*isize)[0] = *natoms;
+		}
+		return;
+	}
+
+	open_traj_stream(traj_fname, ndx_fname, ngroups, oenv, skip, &stream);
+	*natoms = stream.natoms;
+	if(isize) {
+		snew(*isize, stream.ngroups);
+		memcpy(*isize, stream.isize, stream.ngroups * sizeof(int));
+	}
+	*nframes = 0;
+
+	snew(*x, est_frames);
+	snew(*box, est_frames);
+	snew((*x)[0], *natoms);
+
+	while(read_traj_stream(&stream, (*x)[*nframes], (*box)[*nframes])) {
+		++(*nframes);
+		if(*nframes >= est_frames) {
+			est_frames += FRAMESTEP;
+			srenew(*x, est_frames);
+			srenew(*box, est_frames);
+		}
+		snew((*x)[*nframes], *natoms);
+	}
+
+	sfree((*x)[*nframes]); // Nothing was read to the last allocated frame
+	close_traj_stream(&stream);
+}
+
+void open_traj_stream(const char *traj_fname, const char *ndx_fname, int ngroups, output_env_t *oenv, int skip, 
+	struct traj_stream *stream) {
+	stream->status = NULL;
+	stream->oenv = oenv;
+	stream->skip = skip > 1 ? skip : 1;
+	stream->natoms_full = read_first_x(*oenv, &(stream->status), traj_fname, &(stream->t), &(stream->frame), stream->box);
+	stream->left = read_first_kept(traj_fname, *(stream->oenv), stream->status, &(stream->t), 
+		stream->natoms_full, stream->frame, stream->box, skip);
+	stream->pending = stream->left != 0;
+	stream->follow = FALSE;
+	stream->wait = 0;
+	stream->fname = NULL;
+
+	if(ndx_fname != NULL) {
+		atom_id **indx;
+
+		stream->ngroups = ngroups > 1 ? ngroups : 1;
+		ndx_get_indx(ndx_fname, stream->ngroups, &indx, &(stream->isize));
+
+		// concatenate the groups
+		stream->natoms = 0;
+		for(int g = 0; g < stream->ngroups; ++g) {
+			stream->natoms += stream->isize[g];
+		}
+		snew(stream->indx, stream->natoms);
+		for(int g = 0, i = 0; g < stream->ngroups; i += stream->isize[g++]) {
+			memcpy(stream->indx + i, indx[g], stream->isize[g] * sizeof(atom_id));
+			sfree(indx[g]);
+		}
+		sfree(indx);
+	}
+	else {
+		stream->indx = NULL;
+		stream->ngroups = 1;
+		snew(stream->isize, 1);
+		stream->natoms = stream->isize[0] = stream->natoms_full;
+	}
+}
+
+void follow_traj_stream(const char *traj_fname, const char *ndx_fname, int ngroups, output_env_t *oenv, int skip, 
+	double wait, struct traj_stream *stream) {
+	struct stat st;
+	gmx_bool pipe = stat(traj_fname, &st) == 0 && S_ISFIFO(st.st_mode);
+
+	// read_first_x cannot wait for a frame or read it again, so only open the file once the first frame is there
+	if(!pipe && !wait_settled(traj_fname, wait))
+		gmx_fatal(FARGS, traj_stop ? "Stopped before the first frame of %s was written\n" 
+			: "No frames were written to %s in %g seconds\n", traj_fname, wait);
+
+	open_traj_stream(traj_fname, ndx_fname, ngroups, oenv, skip, stream);
+	stream->follow = !pipe;
+	stream->wait = wait;
+	if(stream->follow) {
+		snew(stream->fname, strlen(traj_fname) + 1);
+		strcpy(stream->fname, traj_fname);
+	}
+}
+
+gmx_bool read_traj_stream(struct traj_stream *stream, rvec *x, matrix box) {
+	if(traj_stop || stream->left == 0) {
+		return FALSE;
+	}
+	else if(stream->pending) {
+		stream->pending = FALSE;
+	}
+	else if(stream->follow) {
+		t_fileio *fio = trx_get_fileio(stream->status);
+		gmx_off_t start = gmx_fio_ftell(fio);
+
+		while(TRUE) {
+			// the size before the read, so that a frame that is finished during a failed read counts as new data
+			off_t size = file_size(stream->fname);
+			if(read_next_kept(*(stream->oenv), stream->status, &(stream->t), 
+				stream->natoms_full, stream->frame, stream->box, stream->skip))
+				break;
+			// the end of the file was reached, possibly in the middle of a frame that is still being written,
+			// which is read again from its start as soon as anything has been added
+			if(!wait_growth(stream->fname, size, stream->wait))
+				return FALSE;
+			gmx_fio_seek(fio, start);
+		}
+	}
+	else if(!read_next_kept(*(stream->oenv), stream->status, &(stream->t), 
+		stream->natoms_full, stream->frame, stream->box, stream->skip)) {
+		return FALSE;
+	}
+
+	if(stream->indx) {
+		for(int i = 0; i < stream->natoms; ++i) {
+			copy_rvec(stream->frame[stream->indx[i]], x[i]);
+		}
+	}
+	else {
+		for(int i = 0; i < stream->natoms; ++i) {
+			copy_rvec(stream->frame[i], x[i]);
+		}
+	}
+	copy_mat(stream->box, box);
+	if(stream->left > 0)
+		--(stream->left);
+
+	return TRUE;
+}
+
+void close_traj_stream(struct traj_stream *stream) {
+	close_trx(stream->status);
+	sfree(stream->frame);
+	if(stream->indx)	sfree(stream->indx);
+	if(stream->fname)	sfree(stream->fname);
+	sfree(stream->isize);
+}
+
 void print_traj(rvec **x, int nframes, int natoms, const char *fname) {
 	int fr, i;
 	FILE *f = fopen(fname, "w");
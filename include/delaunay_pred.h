@@ -0,0 +1,104 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ *
+ * Floating-point filtered versions of the orient2d and incircle predicates of
+ *
+ * Shewchuk, J.R. 1996.
+ * Routines for Arbitrary Precision Floating-point Arithmetic and Fast Robust Geometric Predicates.
+ *
+ * The determinants are first evaluated in plain double arithmetic,
+ * and their signs are trusted if they are larger than a static error bound
+ * computed once from the coordinate range of the point set.
+ * Otherwise, Shewchuk's exact adaptive routines decide,
+ * so the results are exactly as robust as calling them directly.
+ */
+
+#ifndef DELAUNAY_PRED_H
+#define DELAUNAY_PRED_H
+
+#include <float.h>
+#include "delaunay_tri.h"
+#include "gta_timing.h"
+
+
+// Error bounds of the filtered predicates for points within a given coordinate range
+struct dtFilter {
+    dtreal orient_bound;
+    dtreal incircle_bound;
+};
+
+
+static inline void dtfilter_init(struct dtFilter *f, dtreal range);
+/* Computes the error bounds for points whose x-coordinates and y-coordinates each lie within an interval of length range.
+ * The bounds are valid for any predicate on these points as long as none of them move.
+ */
+
+static inline dtreal dtorient2d(const struct dtFilter *f,
+                                const dtreal *pa,
+                                const dtreal *pb,
+                                const dtreal *pc);
+/* Same sign as orient2d(pa, pb, pc): positive if pa, pb and pc are in counterclockwise order,
+ * negative if clockwise, zero if collinear.
+ */
+
+static inline dtreal dtincircle(const struct dtFilter *f,
+                                const dtreal *pa,
+                                const dtreal *pb,
+                                const dtreal *pc,
+                                const dtreal *pd);
+/* Same sign as incircle(pa, pb, pc, pd): positive if pd is inside the circle through pa, pb and pc
+ * (which must be in counterclockwise order), negative if outside, zero if on the circle.
+ */
+
+
+// The bounds follow from Shewchuk's a posteriori bounds
+// |error| <= (3 + 16e)e * (|detleft| + |detright|) for orient2d and
+// |error| <= (10 + 96e)e * permanent for incircle, e = DBL_EPSILON / 2.
+// Every computed coordinate difference is at most the range R of the points,
+// so |detleft| + |detright| <= 2R^2 and permanent <= 12R^4 (up to a few roundings),
+// giving bounds of about 6eR^2 and 120eR^4, which are rounded up to 8eR^2 and 128eR^4.
+static inline void dtfilter_init(struct dtFilter *f, dtreal range) {
+    dtreal range2 = range * range;
+    f->orient_bound = 8.0 * (DBL_EPSILON / 2) * range2;
+    f->incircle_bound = 128.0 * (DBL_EPSILON / 2) * range2 * range2;
+}
+
+static inline dtreal dtorient2d(const struct dtFilter *f,
+                                const dtreal *pa,
+                                const dtreal *pb,
+                                const dtreal *pc) {
+    dtreal det = (pa[0] - pc[0]) * (pb[1] - pc[1])
+               - (pa[1] - pc[1]) * (pb[0] - pc[0]);
+
+    if(det > f->orient_bound || -det > f->orient_bound) {
+        gta_count(GTA_C_ORIENT_FAST, 1);
+        return det;
+    }
+
+    gta_count(GTA_C_ORIENT_EXACT, 1);
+    return orient2d((dtreal*)pa, (dtreal*)pb, (dtreal*)pc);
+}
+
+static inline dtreal dtincircle(const struct dtFilter *f,
+                                const dtreal *pa,
+                                const dtreal *pb,
+                                const dtreal *pc,
+                                const dtreal *pd) {
+    dtreal adx = pa[0] - pd[0], ady = pa[1] - pd[1];
+    dtreal bdx = pb[0] - pd[0], bdy = pb[1] - pd[1];
+    dtreal cdx = pc[0] - pd[0], cdy = pc[1] - pd[1];
+
+    dtreal det = (adx * adx + ady * ady) * (bdx * cdy - cdx * bdy)
+               + (bdx * bdx + bdy * bdy) * (cdx * ady - adx * cdy)
+               + (cdx * cdx + cdy * cdy) * (adx * bdy - bdx * ady);
+
+    if(det > f->incircle_bound || -det > f->incircle_bound) {
+        gta_count(GTA_C_INCIRCLE_FAST, 1);
+        return det;
+    }
+
+    gta_count(GTA_C_INCIRCLE_EXACT, 1);
+    return incircle((dtreal*)pa, (dtreal*)pb, (dtreal*)pc, (dtreal*)pd);
+}
+
+#endif // DELAUNAY_PRED_H
@@ -19,13 +19,23 @@
  * Routines for Arbitrary Precision Floating-point Arithmetic and Fast Robust Geometric Predicates.
  */
 
+#ifndef DELAUNAY_TRI_H
+#define DELAUNAY_TRI_H
+
+#include <stddef.h>
 #include "predicates.h"
 
 typedef REAL dtreal;
 
 
 struct dTriangulation {
-    dtreal *points; // coordinates of input points (2 ordered reals, x and y, per point)
+    dtreal *points; // coordinates of input points (2 ordered reals, x and y, per point), 
+                    // or NULL to triangulate the single precision points below instead
+    const float *fpoints; // single precision input points, read in place with a stride (see dtpoint below). 
+                          // Only used if points is NULL
+    const float *fpoints2; // continuation of fpoints: points nfpoints, nfpoints + 1, ... Can be NULL if nfpoints == npoints
+    int nfpoints; // number of points in fpoints
+    int fstride; // distance between two points of fpoints and fpoints2 in floats, ex. 3 for the x and y of an rvec array
     int npoints;
 
     int *triangles; // list of delaunay triangles as groups of three point indexes 
@@ -35,6 +45,26 @@ struct dTriangulation {
 };
 
 
+// Reusable triangulation buffers (see dtriangulate_ws below)
+struct dtWorkspace;
+
+
+/* Stores the x and y coordinates of point i of tri in xy, promoted to dtreal if tri has single precision points.
+ */
+static inline void dtpoint(const struct dTriangulation *tri, int i, dtreal *xy) {
+    if(tri->points) {
+        xy[0] = tri->points[2*i];
+        xy[1] = tri->points[2*i+1];
+    }
+    else {
+        const float *p = i < tri->nfpoints ? tri->fpoints + (size_t)i * tri->fstride 
+                                           : tri->fpoints2 + (size_t)(i - tri->nfpoints) * tri->fstride;
+        xy[0] = p[0];
+        xy[1] = p[1];
+    }
+}
+
+
 void dtinit();
 /* Call this once before calling dtriangulate()
  */
@@ -44,3 +74,39 @@ void dtriangulate(struct dTriangulation *tri);
  * storing the resulting triangles in tri (see struct above).
  * Memory is allocated for tri->triangles.
  */
+
+struct dtWorkspace *dtws_new();
+/* Allocates an empty workspace for dtriangulate_ws. Call dtws_free when done.
+ * A workspace must not be used by more than one thread at a time.
+ */
+
+void dtws_free(struct dtWorkspace *ws);
+/* Frees a workspace and all of its buffers.
+ */
+
+dtreal *dtws_points(struct dtWorkspace *ws, int npoints);
+/* Returns the workspace's input point buffer, grown to hold at least npoints points (2 reals each).
+ * Its contents are not kept if it has to grow.
+ * Point this to tri->points to triangulate without allocating an input buffer for every call.
+ */
+
+void dtriangulate_ws(struct dTriangulation *tri, struct dtWorkspace *ws);
+/* Same as dtriangulate, but uses the buffers of ws instead of allocating memory for every call.
+ * Buffers only grow when a triangulation needs more space than any previous one.
+ * tri->triangles points into ws, so do not free it. 
+ * It stays valid until the next call with the same ws.
+ */
+
+int dtriangulate_inc_ws(struct dTriangulation *tri, struct dtWorkspace *ws);
+/* Same as dtriangulate_ws, but if the last call with ws triangulated the same points array 
+ * (same tri->points and tri->npoints), whose points have only moved a little since, 
+ * the previous triangulation is repaired with edge flips instead of being recomputed from scratch.
+ * Single precision points are taken to be the same points if npoints and nfpoints are the same, 
+ * since each frame of a trajectory usually comes in a different array.
+ * This is always safe: points that no longer fit the previous triangulation make it start from scratch.
+ * Falls back to dtriangulate_ws if there is no usable previous triangulation, 
+ * if the points moved too much, or if the previous points contained duplicates.
+ * Returns 1 if the previous triangulation was repaired, 0 if the points were triangulated from scratch.
+ */
+
+#endif // DELAUNAY_TRI_H
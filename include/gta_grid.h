@@ -19,12 +19,21 @@
 #include "statutil.h"
 #endif
 
+#define GRID_BRICK 8 // Number of grid points along each edge of a brick of weights
+
 /* Struct for a weighted 3D grid and its associated information.
  * Note: some of the arrays in this struct are multidimensional as indicated by the comments,
  * but are stored as single pointers and addressed using pointer arithmetic.
+ * The weights are stored in cubic bricks of GRID_BRICK^3 grid points that are only allocated 
+ * once a weight in them is loaded, since most of the grid around a bilayer stays empty.
+ * Use grid_weight below to read a weight.
  */
 struct tessellated_grid {
-    real *weights; // [dimx][dimy][dimz]
+    real **bricks; // [bdimx][bdimy][bdimz]. Each brick is [GRID_BRICK][GRID_BRICK][GRID_BRICK], NULL if all of its weights are 0
+    int bdimx, bdimy, bdimz; // Number of bricks in each dimension
+    int ox, oy, oz; // Position in the bricks of grid point [0][0][0] (nonzero only for grids built by stream_gta_grid_area)
+    int **nloads; // [bdimx][bdimy][bdimz]. Bricks of the number of atoms currently loaded into each weight, NULL unless tracked (see track_grid_changes)
+    char *dirty; // [dimx][dimy]. Nonzero for each x-y column whose weights changed since the heightmap was last updated, NULL unless tracked
     int *heightmap; // [dimx][dimy]. Holds the z-index of the grid point with the maximum weight for each x-y column
     real *areas; // [dimx-1][dimy-1]. Holds the triangulated area of each grid cell
     int dimx, dimy, dimz; // Number of grid points in each dimension (this is number of grid cells + 1)
@@ -36,28 +45,63 @@ struct tessellated_grid {
 };
 
 
+/* Returns the weight of grid point [x][y][z].
+ */
+static inline real grid_weight(const struct tessellated_grid *grid, int x, int y, int z) {
+    x += grid->ox, y += grid->oy, z += grid->oz;
+    const real *brick = grid->bricks[((x / GRID_BRICK) * grid->bdimy + y / GRID_BRICK) * grid->bdimz + z / GRID_BRICK];
+    return brick ? brick[((x % GRID_BRICK) * GRID_BRICK + y % GRID_BRICK) * GRID_BRICK + z % GRID_BRICK] : 0;
+}
+
+
+/* Areas of the weighted grids of a sliding window of frames (see window_gta_grid_area below).
+ */
+struct grid_window_area {
+    real *area; // [nwindows] tessellated surface area of the grid of each window
+    int *num_empty; // [nwindows] number of grid cells with empty corner(s) in each window
+    int nwindows; // number of windows, the first frames of which are 0, 1, ..., nwindows - 1
+    int window; // number of frames per window
+    int natoms; // number of atoms per frame
+};
+
+
 /* Weight functions */
 
 real weight_dist(rvec traj_point, rvec grid_point);
 /* Assigns weight based on distance. Closer distance = higher weight.
+ * Returns the negative distance: load_grid adds the diagonal of a grid cell
+ * so that the weights it loads are positive.
  */
 
 real weight_dist2(rvec traj_point, rvec grid_point);
 /* Assigns weight based on distance squared. Closer distance squared = higher weight.
+ * Returns the negative distance squared: load_grid adds the squared diagonal of a grid cell
+ * so that the weights it loads are positive.
  */
 
 /***/
 
 
 void gta_grid_area(const char *traj_fname, const char *ndx_fname, 
-    real cell_width, real (*fweight)(rvec, rvec), output_env_t *oenv, struct tessellated_grid *grid);
+    real cell_width, real (*fweight)(rvec, rvec), output_env_t *oenv, int skip, struct tessellated_grid *grid);
 /* Reads a trajectory file and then calculates approximate surface area (see the f_gta_grid_area function below).
  * If ndx_fname is not null, only a selection within the trajectory will be included in the grid.
  * output_env_t *oenv is needed for reading trajectory files.
  * You can initialize one using output_env_init() in Gromacs's oenv.h.
+ * Only every skip-th frame is read (skip <= 1 reads all frames), see read_traj in gkut_io.h.
  * Memory is allocated for arrays in grid. Call free_grid when done.
  */
 
+void stream_gta_grid_area(const char *traj_fname, const char *ndx_fname, 
+    real cell_width, real (*fweight)(rvec, rvec), output_env_t *oenv, int skip, struct tessellated_grid *grid);
+/* Same as gta_grid_area, but reads the trajectory one frame at a time and loads each frame into the grid
+ * as it is read, so that only one frame is in memory at once.
+ * The grid is anchored at the minimum coordinates of the first frame and grows by whole bricks
+ * whenever a later frame reaches outside of it, then is cropped to the coordinates of all frames at the end.
+ * The grid points are therefore offset from those of gta_grid_area by less than a cell width,
+ * unless the first frame holds the minimum coordinates of the trajectory.
+ */
+
 void f_gta_grid_area(rvec **x, int nframes, int natoms, 
     real cell_width, real (*fweight)(rvec, rvec), struct tessellated_grid *grid);
 /* Calculates the approximate surface area of a trajectory by tessellating the coordinates in a 3D grid.
@@ -69,6 +113,30 @@ void f_gta_grid_area(rvec **x, int nframes, int natoms,
  * Memory is allocated for arrays in grid. Call free_grid when done.
  */
 
+void window_gta_grid_area(const char *traj_fname, const char *ndx_fname, 
+    real cell_width, real (*fweight)(rvec, rvec), int window, output_env_t *oenv, int skip, struct grid_window_area *areas);
+/* Reads a trajectory file and calculates the approximate surface area of every window of the given number of 
+ * consecutive frames (see the f_window_gta_grid_area function below).
+ * Memory is allocated for arrays in areas. Call free_grid_window_area when done.
+ */
+
+void f_window_gta_grid_area(rvec **x, int nframes, int natoms, 
+    real cell_width, real (*fweight)(rvec, rvec), int window, struct grid_window_area *areas);
+/* Calculates the approximate surface area of every window of the given number of consecutive frames
+ * of a trajectory, sliding the window one frame at a time.
+ * All windows share one grid spanning the whole trajectory: the frame that leaves the window is unloaded from it,
+ * the frame that enters is loaded, and only the heightmap columns and grid cells whose weights changed are updated.
+ * Memory is allocated for arrays in areas. Call free_grid_window_area when done.
+ */
+
+void print_grid_window_area(const char *fname, const struct grid_window_area *areas);
+/* Formats and prints the areas of a sliding window to an output file.
+ */
+
+void free_grid_window_area(struct grid_window_area *areas);
+/* Frees the dynamic memory in a grid_window_area struct.
+ */
+
 void construct_grid(rvec **x, int nframes, int natoms, real cell_width, struct tessellated_grid *grid);
 /* Memory is allocated for arrays in grid and initialized to 0.
  * Call free_grid when done with grid.
@@ -79,18 +147,43 @@ void construct_grid(rvec **x, int nframes, int natoms, real cell_width, struct t
 void load_grid(rvec **x, int nframes, int natoms, real (*fweight)(rvec, rvec), struct tessellated_grid *grid);
 /* Loads the given grid with weights based on the given trajectory.
  * Uses fweight to calculate the weight of each grid point - trajectory point pair.
- * You can use one of the weight functions above for fweight.
+ * You can use one of the weight functions above for fweight. 
+ * These are inlined, while other functions are called through the pointer.
+ * Parallelized with OpenMP if built with openmp.
+ */
+
+void track_grid_changes(struct tessellated_grid *grid);
+/* Makes load_grid and unload_grid keep track of the number of atoms loaded into each weight 
+ * and of the columns whose weights change, which unload_grid and update_grid_area need.
+ * Call right after construct_grid, before loading the grid.
+ */
+
+void unload_grid(rvec **x, int nframes, int natoms, real (*fweight)(rvec, rvec), struct tessellated_grid *grid);
+/* Takes out the weights of the given trajectory, which must have been loaded into the grid before with load_grid
+ * (with the same fweight). Weights that have no loaded atoms left are reset to exactly 0.
+ * Parallelized with OpenMP if built with openmp.
  */
 
 void gen_heightmap(struct tessellated_grid *grid);
 /* Finds the z-index of the grid point with the maximum weight for each x-y column in the grid.
- * This data is stored in grid->heightmap
+ * This data is stored in grid->heightmap. Bricks that were never loaded are skipped.
  */
 
 void tessellate_grid(struct tessellated_grid *grid);
 /* Tessellates the heightmap in the given grid and calculates the total area of the triangulated surface. 
  */
 
+void gen_tessellate_grid(struct tessellated_grid *grid);
+/* Same as gen_heightmap followed by tessellate_grid, but in a single pass over the grid 
+ * that is parallelized with OpenMP if built with openmp.
+ */
+
+void update_grid_area(struct tessellated_grid *grid);
+/* Updates the heightmap and the tessellated surface area of a tracked grid after its weights were changed 
+ * by load_grid or unload_grid. Only the heightmap columns whose weights changed and the grid cells around them
+ * are recomputed. gen_heightmap and tessellate_grid must have been called once before.
+ */
+
 void print_grid(struct tessellated_grid *grid, const char *fname);
 /* Prints the data in the given tessellated grid to the given file.
  */
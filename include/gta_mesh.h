@@ -0,0 +1,54 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ *
+ * Export of the Delaunay triangulations of all frames of a trajectory into a single file.
+ *
+ * All values are in the byte order of the machine that wrote the file. The file starts with
+ *   char magic[8]          "GTAMESH" followed by a 0 byte
+ *   uint32 byte_order      0x01020304 as written, to detect the byte order
+ *   uint32 version         1
+ * followed by one block per group of each frame, in the order in which they were triangulated:
+ *   int32 frame            frame number (0 is the first frame triangulated)
+ *   int32 group            group number (0 if the frames were not split into groups)
+ *   int32 npoints
+ *   int32 ntriangles
+ *   uint32 nbytes          size of the encoded triangles below
+ *   float points[npoints][2]  x and y of the triangulated points (atoms, then edge correction points)
+ *   uint8 triangles[nbytes]   the 3 * ntriangles point indexes of the triangles, each stored as the
+ *                             difference to the index before it (0 for the first one), zigzag-encoded
+ *                             (d >= 0 -> 2d, d < 0 -> -2d - 1) in little-endian base-128 varints
+ * The file ends with an index of the blocks sorted by frame number, then group number:
+ *   int64 nblocks
+ *   struct {int32 frame; int32 group; int64 offset;} blocks[nblocks]  offset of each block from the start of the file
+ *   int64 index_offset     offset of nblocks above
+ *   char magic[8]          "GTAMIDX" followed by a 0 byte
+ */
+
+#ifndef GTA_MESH_H
+#define GTA_MESH_H
+
+#include "delaunay_tri.h"
+
+
+// Writes the blocks of a mesh file from a dedicated thread (see open_mesh_writer below)
+struct gta_mesh_writer;
+
+
+struct gta_mesh_writer *open_mesh_writer(const char *fname, int nbuf);
+/* Creates a mesh file and starts its writer thread.
+ * Up to nbuf encoded frames can be waiting for the writer before write_mesh blocks.
+ * nbuf <= 0 uses a default. Returns NULL if the file could not be created.
+ * Call close_mesh_writer when done.
+ */
+
+void write_mesh(struct gta_mesh_writer *w, int frame, int group, const struct dTriangulation *tri);
+/* Encodes the triangulation of the given group of the given frame in the calling thread
+ * and queues it for the writer thread. Can be called from several threads at once,
+ * which can give the frames in any order.
+ */
+
+void close_mesh_writer(struct gta_mesh_writer *w);
+/* Waits for the writer thread to write all queued frames, writes the index and closes the file.
+ */
+
+#endif // GTA_MESH_H
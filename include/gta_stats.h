@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ *
+ * Running statistics of the areas of a trajectory (see the -stats option of g_tessla),
+ * kept in memory that does not depend on the number of frames:
+ * the mean and variance of each area (Welford's algorithm), the standard error of the mean estimated
+ * from averages over blocks of 1, 2, 4, ... consecutive frames (Flyvbjerg and Petersen's blocking method,
+ * J. Chem. Phys. 1989;91(1):461-466) and a histogram of the area per particle.
+ * All sums are kept in double.
+ */
+
+#ifndef GTA_STATS_H
+#define GTA_STATS_H
+
+#define GTA_BLOCK_LEVELS 40 // Number of block sizes 1, 2, 4, ..., enough for 2^40 frames
+
+
+// Number, mean and sum of squared deviations from the mean of a set of values
+struct gta_moments {
+    long n;
+    double mean, m2;
+};
+
+// Running statistics of one quantity, whose values must be added in frame order.
+// block[k] holds the moments of the averages of consecutive blocks of 2^k frames (block[0] those of the frames themselves),
+// and carry[k] the average of the last block of 2^k frames if it still waits for a second one to form a block of twice the size.
+struct gta_series {
+    struct gta_moments block[GTA_BLOCK_LEVELS];
+    double carry[GTA_BLOCK_LEVELS];
+    unsigned char has_carry[GTA_BLOCK_LEVELS];
+    double min, max;
+};
+
+// Histogram of bins of equal width
+struct gta_hist {
+    long *count; // [nbins]
+    long under, over; // number of values below min and at or above max
+};
+
+struct gta_stats {
+    double hist_min, hist_max; // range of the histograms
+    int hist_bins; // number of bins of the histograms
+    int ngroups; // 0 until gta_stats_groups is called
+    int *group_natoms; // [ngroups] number of atoms of each group
+    struct gta_series *area; // [ngroups] 3D area of each group
+    struct gta_series *area2D; // [ngroups] 2D area of each group, NULL if not calculated
+    struct gta_series box; // 2D area of the box
+    struct gta_hist *hist; // [ngroups] 3D area per particle of each group
+};
+
+
+void gta_stats_init(struct gta_stats *stats, double hist_min, double hist_max, int hist_bins);
+/* Sets up empty statistics whose histograms have hist_bins bins from hist_min to hist_max.
+ * The groups are set by gta_stats_groups. Call gta_stats_free when done.
+ */
+
+void gta_stats_groups(struct gta_stats *stats, int ngroups, const int *group_natoms, int has2D);
+/* Allocates the statistics of ngroups groups with the given numbers of atoms,
+ * including their 2D areas if has2D is nonzero.
+ */
+
+void gta_stats_clone(struct gta_stats *dst, const struct gta_stats *src);
+/* Sets up empty statistics with the same groups and histograms as src in dst, for example one for each thread.
+ */
+
+void gta_stats_add(struct gta_stats *stats, int group, double a3D, double a2D);
+/* Adds the 3D and 2D areas (a2D is ignored if 2D areas are not calculated) of the next frame of a group.
+ * The frames of each group must be added in order.
+ */
+
+void gta_stats_add_box(struct gta_stats *stats, double a2Dbox);
+/* Adds the box area of the next frame.
+ */
+
+void gta_stats_merge(struct gta_stats *dst, const struct gta_stats *src);
+/* Adds the statistics in src, whose frames come right after those in dst, to dst.
+ * Blocks are not formed across the boundary between the two, so the block averages of 2^k frames
+ * leave out fewer than 2^k frames at the end of dst and at the end of src.
+ */
+
+void gta_stats_print(const char *fname, const struct gta_stats *stats);
+/* Saves the statistics to a text file: the mean, standard deviation, minimum, maximum,
+ * standard error and block standard error of every area and area per particle,
+ * then the standard errors of every block size and the histograms.
+ * The block standard error is the largest standard error of the block sizes with at least 32 blocks,
+ * which is where the blocking method levels off once the blocks are longer than the correlation time of the areas.
+ */
+
+void gta_stats_free(struct gta_stats *stats);
+/* Frees the dynamic memory in a gta_stats struct.
+ */
+
+#endif // GTA_STATS_H
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ *
+ * Per-thread wall-clock timers of the pipeline stages and counters of the triangulation hot paths.
+ * Everything is off until gta_timing_init is called (the -timing option of g_tessla),
+ * so that the timers and counters only cost a predictable branch otherwise.
+ */
+
+#ifndef GTA_TIMING_H
+#define GTA_TIMING_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Timed stages
+enum {
+    GTA_T_READ, // reading and index filtering of the trajectory
+    GTA_T_EDGE, // edge correction points for periodic bounds (add_edge_points)
+    GTA_T_SORT, // sorting of the points and removal of duplicates (sortVerts)
+    GTA_T_MERGE, // divide and conquer triangulation (ord_dtriangulate)
+    GTA_T_REPAIR, // edge flips of incremental triangulations (repairTris)
+    GTA_T_CONVERT, // conversion of the quad-edge mesh to a triangle list (convertTris)
+    GTA_T_AREA, // summation of the triangle areas
+    GTA_T_OUTPUT, // -print, -mesh and area output
+    GTA_T_FRAME, // all of the work on a frame, for the load balance of the frame loop
+    GTA_T_NUM
+};
+
+// Counted events
+enum {
+    GTA_C_ORIENT_FAST, // orient2d decided by the floating-point filter
+    GTA_C_ORIENT_EXACT, // orient2d that needed Shewchuk's exact routine
+    GTA_C_INCIRCLE_FAST, // incircle decided by the floating-point filter
+    GTA_C_INCIRCLE_EXACT, // incircle that needed Shewchuk's exact routine
+    GTA_C_EDGES, // quad-edges allocated (makeEdge)
+    GTA_C_FLIPS, // edges flipped by incremental triangulations
+    GTA_C_DUPLICATES, // duplicate points removed
+    GTA_C_FRAMES, // frames (or groups of frames) triangulated
+    GTA_C_NUM
+};
+
+// Timers and counters of one thread, padded so that two threads never share a cache line
+struct gta_timing_slot {
+    double time[GTA_T_NUM];
+    long count[GTA_C_NUM];
+    char pad[64];
+};
+
+extern int gta_timing_on; // nonzero after gta_timing_init
+extern int gta_timing_nslots;
+extern struct gta_timing_slot *gta_timing_slots; // [gta_timing_nslots]
+
+
+void gta_timing_init(int nthreads);
+/* Enables the timers and counters and resets them to zero.
+ * nthreads is the largest number of threads that will be used (<= 0 for the OpenMP default).
+ */
+
+double gta_timing_now();
+/* Returns a monotonic wall-clock time in seconds.
+ */
+
+void gta_timing_report();
+/* Prints the time spent in each stage summed over all threads, the counters
+ * and the busy time of each thread in the frame loop to the log (see gkut_log.h).
+ * Does nothing if gta_timing_init was not called.
+ */
+
+
+// Timers and counters of the calling thread
+static inline struct gta_timing_slot *gta_timing_slot() {
+#ifdef _OPENMP
+    int t = omp_get_thread_num();
+    return &gta_timing_slots[t < gta_timing_nslots ? t : gta_timing_nslots - 1];
+#else
+    return gta_timing_slots;
+#endif
+}
+
+// Returns the start time of a stage, to be passed to gta_toc
+static inline double gta_tic() {
+    return gta_timing_on ? gta_timing_now() : 0;
+}
+
+// Adds the time since start to a stage of the calling thread
+static inline void gta_toc(int stage, double start) {
+    if(gta_timing_on)
+        gta_timing_slot()->time[stage] += gta_timing_now() - start;
+}
+
+static inline void gta_count(int counter, long n) {
+    if(gta_timing_on)
+        gta_timing_slot()->count[counter] += n;
+}
+
+#endif // GTA_TIMING_H
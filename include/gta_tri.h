@@ -18,73 +18,170 @@
 #else
 #include "statutil.h"
 #endif
+#include "gtessla.h" // flags, schedules and struct gta_options
+#include "gta_stats.h"
 
 
-// Flags
-enum {
-    GTA_CORRECT = 1, // Correct areas for periodic bounding conditions
-    GTA_2D = 2, // Calculate 2D surface area as well
-    GTA_PRINT = 4, // Print triangle data that can be visualized using, for example, the 'showme' program
-};
+struct dtWorkspace;
+
 
 // Struct for area output data.
 // These are total surface area, divide a given area by natoms to get area per particle.
+// The atoms of each frame can be split into several groups that are triangulated separately, 
+// in which case divide the areas of a group by group_natoms of that group instead.
 struct tri_area {
-    real *area; // Triangulated 3D areas indexed by [frame #]. *area are corrected areas for periodic bounds if GTA_CORRECT was used.
-    real *area2D; // Triangulated 2D areas indexed by [frame #]. NULL if GTA_2D not set.
+    real *area; // Triangulated 3D areas indexed by [frame # * ngroups + group #]. *area are corrected areas for periodic bounds if GTA_CORRECT was used.
+    real *area2D; // Triangulated 2D areas indexed by [frame # * ngroups + group #]. NULL if GTA_2D not set.
     real *area2Dbox; // 2D areas of box for each frame.
     int natoms, nframes; // Number of atoms and number of frames, respectively, that were triangulated.
+    int ngroups; // Number of groups. 0 or 1 means that all natoms atoms form a single group.
+    int *group_natoms; // [ngroups] Number of atoms of each group, whose atoms follow those of the group before in each frame. Can be NULL for a single group.
+    struct gta_stats *stats; // Set by the caller. If not NULL, tessellate_area, stream_tessellate_area and delaunay_tessellate
+                             // only add the areas of each frame to these statistics (see gta_stats.h), and area, area2D and area2Dbox are NULL.
 };
 
 
 void tessellate_area(const char *traj_fname, 
                      const char *ndx_fname, 
+                     int ngroups, 
                      output_env_t *oenv, 
-                     real espace, 
-                     int nthreads, 
-                     struct tri_area *areas, 
-                     unsigned char flags);
+                     int skip, 
+                     const struct gta_options *opt, 
+                     const char *mesh_fname, 
+                     const char *vertex_fname, 
+                     struct tri_area *areas);
 /* Reads a trajectory file and tessellates all of its frames.
  * If ndx_fname is not null, only a selection within the trajectory will be tessellated.
+ * Each of the first ngroups groups of the index file is then tessellated separately (ngroups <= 1 for a single group).
  * output_env_t *oenv is needed for reading trajectory files.
  * You can initialize one using output_env_init() in Gromacs's oenv.h.
+ * Only every skip-th frame is read (skip <= 1 reads all frames), see read_traj in gkut_io.h.
+ * If vertex_fname is not NULL, the area of every atom of every frame is saved to that file (see gta_vertex.h).
  * Calls the delaunay_tessellate function below.
  */
 
+void stream_tessellate_area(const char *traj_fname, 
+                            const char *ndx_fname, 
+                            int ngroups, 
+                            output_env_t *oenv, 
+                            int skip, 
+                            const struct gta_options *opt, 
+                            int nbuf, 
+                            const char *mesh_fname, 
+                            const char *vertex_fname, 
+                            struct tri_area *areas);
+/* Same as tessellate_area, but reads and tessellates the trajectory frame by frame
+ * instead of loading the whole trajectory into memory first.
+ * Frames are filtered by the index file as they are read and handed to worker threads
+ * through a rolling buffer of nbuf frames, where the buffer of a frame is refilled as soon as it has been tessellated,
+ * so peak memory depends on nbuf and not on the trajectory length.
+ * With OpenMP, this needs the taskwait depend of OpenMP 5.0 (GCC 9 or later).
+ * nbuf <= 0 will buffer a few frames per thread.
+ * Streaming mode always hands out frames as they are read, so opt->schedule and opt->chunk are not used.
+ * With areas->stats, the areas of each batch of frames are added to the statistics in frame order once the batch is done.
+ * Memory is allocated for arrays in the tri_area struct. Call free_tri_area when done.
+ */
+
+void follow_tessellate_area(const char *traj_fname, 
+                            const char *ndx_fname, 
+                            int ngroups, 
+                            output_env_t *oenv, 
+                            int skip, 
+                            const struct gta_options *opt, 
+                            double wait, 
+                            const char *out_fname, 
+                            const char *mesh_fname, 
+                            const char *vertex_fname, 
+                            struct tri_area *areas);
+/* Same as stream_tessellate_area, but for a trajectory that is still being written (see follow_traj_stream in gkut_io.h).
+ * Each frame is tessellated as soon as it has been written, and its line of print_areas is appended to out_fname 
+ * and flushed right away. The groups of a frame are tessellated in parallel, and large frames are split between the threads.
+ * Returns once no new frame has been written for wait seconds (wait <= 0 waits forever).
+ * opt->schedule and opt->chunk are not used, and neither is areas->stats.
+ * Memory is allocated for arrays in the tri_area struct, which holds the areas of all frames at the end. Call free_tri_area when done.
+ */
+
 void delaunay_tessellate(rvec **x, 
                          matrix *box, 
-                         real espace, 
-                         int nthreads, 
-                         struct tri_area *areas, 
-                         unsigned char flags);
-/* Tesssellates all of the frames in the given trajectory using delaunay triangulation.
- * espace is the spacing of the edge correction point intervals if using the GTA_CORRECT flag.
- * nthreads is the number of threads to be used if built with openmp.
- * nthreads <= 0 will use all available threads.
+                         const struct gta_options *opt, 
+                         const char *mesh_fname, 
+                         const char *vertex_fname, 
+                         struct tri_area *areas);
+/* Tesssellates all of the frames in the given trajectory using delaunay triangulation
+ * with the options in opt (see gtessla.h).
+ * If mesh_fname is not NULL, the triangulations of all frames are saved to that file (see gta_mesh.h)
+ * by a separate writer thread so that the frames can still be triangulated in parallel.
+ * If vertex_fname is not NULL, every thread writes the areas of the atoms of its frames to that file (see gta_vertex.h).
+ * areas->nframes and areas->natoms must be set to the size of the trajectory, 
+ * and areas->ngroups and areas->group_natoms to its groups if more than one group is to be tessellated.
+ * Every group of every frame is tessellated separately, in parallel.
+ * With areas->stats, every thread keeps statistics of its own frames, which are merged in frame order at the end.
+ * This needs each thread to have one contiguous block of frames, so GTA_SCHED_STATIC with the default chunk is always used.
  * Memory is allocated for arrays in the tri_area struct. Call free_tri_area when done.
- * See above for flags.
  */
 
 void delaunay_surface_area(const rvec *x, 
                            matrix box, 
                            int natoms, 
                            unsigned char flags, 
+                           int frame, 
                            real *a2D, 
                            real *a3D);
 /* Tessellates the given array of coordinates using delaunay triangulation 
  * and calculates 2D and 3D area, stored in a2D and a3D.
  * a2D and/or a3D can be NULL.
- * See above for flags.
+ * frame numbers the files of GTA_PRINT. See gtessla.h for flags.
+ */
+
+void delaunay_surface_area_ws(const rvec *x, 
+                              matrix box, 
+                              int natoms, 
+                              unsigned char flags, 
+                              int frame, 
+                              real *a2D, 
+                              real *a3D, 
+                              struct dtWorkspace *ws);
+/* Same as delaunay_surface_area, but reuses the triangulation buffers in ws 
+ * (see dtws_new in delaunay_tri.h) instead of allocating them for every call.
+ * Use one workspace per thread.
  */
 
 void print_areas(const char *fname, const struct tri_area *areas);
 /* Formats and prints the data in a tri_area struct to an output file.
  */
 
+void print_areas_bin(const char *fname, const struct tri_area *areas, unsigned char flags);
+/* Saves the areas in a tri_area struct to a binary columnar file that can be mmap'd, 
+ * for example with numpy.memmap. flags are the flags the areas were calculated with.
+ * All values are in the byte order of the machine that wrote the file:
+ *   char magic[8]          "GTAAREA" followed by a 0 byte
+ *   uint32 byte_order      0x01020304 as written, to detect the byte order
+ *   uint32 version         1
+ *   uint32 header_size     offset of the first column in bytes, a multiple of 64
+ *   uint32 real_size       size of each value in bytes, 4 (float) or 8 (double)
+ *   int64 nframes
+ *   int32 natoms
+ *   uint32 flags
+ *   uint32 ncols
+ *   char names[ncols][16]  0-terminated column names: area, area2D (only if GTA_2D was set) and area2Dbox.
+ *                          With several groups, area.g and area2D.g for each group g, then area2Dbox.
+ *   uint32 ngroups
+ *   int32 group_natoms[ngroups]  number of atoms of each group (natoms for a single group)
+ * followed by zero padding up to header_size and then each column of nframes values, one after the other.
+ */
+
 void free_tri_area(struct tri_area *areas);
 /* Frees the dynamic memory in a tri_area struct.
  */
 
+#ifdef GTA_MPI
+void gather_tri_area(struct tri_area *areas);
+/* Collective over MPI_COMM_WORLD. Gathers the areas of all ranks on rank 0, in frame order,
+ * after each rank r has tessellated the r-th of nranks blocks of consecutive frames of the same trajectory
+ * (see set_traj_partition in gkut_io.h). The areas of the other ranks are left as they are.
+ */
+#endif
+
 
 /* Calculates the area of the triangle formed by three points in 3D space.
  */
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ *
+ * Export of the area of every atom of every frame into a single binary file (see the -overt option of g_tessla).
+ * The area of each triangle is split evenly between its atoms, which gives the barycentric dual area of each atom.
+ * Edge correction points are not atoms, so the atoms of a triangle with edge correction points share its whole area.
+ * The areas of all atoms of a group thus add up to its total area, 
+ * except for the triangles between edge correction points only, which belong to no atom.
+ *
+ * All values are in the byte order of the machine that wrote the file:
+ *   char magic[8]          "GTAVERT" followed by a 0 byte
+ *   uint32 byte_order      0x01020304 as written, to detect the byte order
+ *   uint32 version         1
+ *   uint32 header_size     offset of the first frame in bytes, a multiple of 64
+ *   uint32 value_size      size of each area in bytes, always 4 (float)
+ *   int64 nframes
+ *   int32 natoms
+ *   uint32 ngroups
+ *   int32 group_natoms[ngroups]  number of atoms of each group (natoms for a single group)
+ * followed by zero padding up to header_size and then the natoms areas of each frame, one frame after the other,
+ * which can be mapped as a float array of [nframes][natoms], for example with numpy.memmap.
+ * The atoms of a frame are in the order of the index file, each group following the group before it.
+ */
+
+#ifndef GTA_VERTEX_H
+#define GTA_VERTEX_H
+
+
+// Writes the rows of an area file, see open_vertex_writer below
+struct gta_vertex_writer;
+
+
+struct gta_vertex_writer *open_vertex_writer(const char *fname, int natoms, int ngroups, const int *group_natoms);
+/* Creates an area file for frames of natoms atoms, split into ngroups groups (ngroups <= 1 for a single group).
+ * Returns NULL if the file could not be created. Call close_vertex_writer when done.
+ */
+
+void write_vertex_areas(struct gta_vertex_writer *w, int frame, int group, const float *area);
+/* Writes the areas of the atoms of the given group of the given frame.
+ * Every frame and group has its own place in the file, so this can be called from several threads at once,
+ * with the frames in any order.
+ */
+
+void close_vertex_writer(struct gta_vertex_writer *w, int nframes);
+/* Writes the header for nframes frames and closes the file.
+ */
+
+#endif // GTA_VERTEX_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ *
+ * Library interface of g_tessla (libgtessla, see make lib).
+ * It only uses plain C types, so it can be used without the GROMACS headers.
+ * Coordinates are caller-owned float buffers of x, y and z per atom.
+ *
+ * All state lives in a gta_context, so different contexts can be used from different threads at once,
+ * for example to tessellate frames from several simulations concurrently.
+ * A single context must not be used by more than one thread at a time.
+ */
+
+#ifndef GTESSLA_H
+#define GTESSLA_H
+
+#include <stddef.h>
+
+
+// Flags
+enum {
+    GTA_CORRECT = 1, // Correct areas for periodic bounding conditions
+    GTA_2D = 2, // Calculate 2D surface area as well
+    GTA_PRINT = 4, // Print triangle data that can be visualized using, for example, the 'showme' program
+    GTA_INCREMENTAL = 8, // Repair the previous triangulation of each workspace instead of triangulating from scratch when possible,
+                         // only together with GTA_CORRECT, without which the convex hull changes and the repair fails
+};
+
+// Distributions of the frames over the threads
+enum {
+    GTA_SCHED_STATIC, // Blocks of frames fixed in advance, by default one contiguous block per thread
+    GTA_SCHED_DYNAMIC, // Chunks of frames handed out to whichever thread is free
+    GTA_SCHED_GUIDED // Like GTA_SCHED_DYNAMIC, but the chunks shrink towards the end of the trajectory
+};
+
+// Options of a tessellation
+struct gta_options {
+    unsigned char flags; // See above
+    double espace; // Spacing of the edge correction point intervals if using GTA_CORRECT
+    int nthreads; // Number of threads to be used if built with openmp, <= 0 uses all available threads
+    int schedule; // Distribution of the frames over the threads, see above
+    int chunk; // Number of consecutive frames handed out at a time, <= 0 uses the OpenMP default
+               // (one block per thread for GTA_SCHED_STATIC, 1 for GTA_SCHED_DYNAMIC).
+               // The dynamic schedules balance frames of different cost, while GTA_SCHED_STATIC with a large chunk
+               // keeps consecutive frames on the same thread, which GTA_INCREMENTAL needs to pay off.
+};
+
+// Options and reusable per-thread buffers of a tessellation
+struct gta_context;
+
+
+void gta_options_init(struct gta_options *opt);
+/* Sets the default options: no flags, espace = 0.8, all threads and GTA_SCHED_STATIC with chunk 0.
+ */
+
+struct gta_context *gta_context_new(const struct gta_options *opt);
+/* Creates a context with a copy of the given options. Call gta_context_free when done.
+ */
+
+void gta_context_free(struct gta_context *ctx);
+
+int gta_frame_area(struct gta_context *ctx,
+                   const float *xyz,
+                   size_t natoms,
+                   size_t stride,
+                   const float box[9],
+                   int frame,
+                   double *a2Dbox,
+                   double *a2D,
+                   double *a3D);
+/* Tessellates one frame in the calling thread and stores its box area, 2D area and 3D area.
+ * Atom i has the coordinates xyz[i * stride] through xyz[i * stride + 2] (stride >= 3).
+ * box is the box matrix of the frame, row by row.
+ * frame numbers the files of GTA_PRINT. a2Dbox, a2D and a3D can be NULL.
+ * Returns 0 on success and -1 if the frame has too few or too many atoms.
+ */
+
+int gta_frames_area(struct gta_context *ctx,
+                    const float *xyz,
+                    size_t nframes,
+                    size_t natoms,
+                    size_t stride,
+                    size_t frame_stride,
+                    const float *box,
+                    double *a2Dbox,
+                    double *a2D,
+                    double *a3D);
+/* Tessellates nframes frames in parallel and stores their areas in the arrays a2Dbox, a2D and a3D of nframes values each,
+ * any of which can be NULL. Frame fr starts at xyz + fr * frame_stride and has its box at box + 9 * fr.
+ * The atoms of a frame are laid out as in gta_frame_area.
+ * Returns 0 on success and -1 if the frames have too few or too many atoms.
+ */
+
+int gta_grid_frames_area(const struct gta_options *opt,
+                         const float *xyz,
+                         size_t nframes,
+                         size_t natoms,
+                         size_t stride,
+                         size_t frame_stride,
+                         double cell_width,
+                         int linear,
+                         double *area,
+                         int *num_empty);
+/* Calculates the approximate surface area of all the frames by tessellating them in a weighted 3D grid (see gta_grid.h)
+ * with opt->nthreads threads. cell_width is the width of each grid cell, and the weights are the distance to the atoms
+ * if linear is nonzero and the distance squared otherwise. The frames are laid out as in gta_frames_area.
+ * The area is stored in area and the number of grid cells with empty corners in num_empty, which can be NULL.
+ * Returns 0 on success and -1 if there are no atoms or too many.
+ */
+
+#endif // GTESSLA_H
@@ -20,86 +20,152 @@
  */
 
 #include "delaunay_tri.h"
+#include "delaunay_pred.h"
+#include "gta_timing.h"
 
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define DTEPSILON 1e-12
 #define MINPOINTS 2
+#define TASKCUTOFF 4096 // Minimum number of points for which the two halves are triangulated in parallel
+#define MAXFLIPS 0.5 // Maximum number of edge flips per point before dtriangulate_inc_ws starts from scratch
+#define RADIXCUTOFF 64 // Minimum number of points for which sortVerts uses a radix sort instead of an insertion sort
+#define RADIXBITS 8
+#define RADIXPASSES (64 / RADIXBITS)
 
 
+// The coordinates are copied into the sorted vertices, promoted to dtreal for single precision input, 
+// so the merge reads them from one contiguous array instead of through pointers into the input order.
 struct vert {
-    dtreal *coord;
-    struct vertNode *adj;
+    dtreal coord[2];
+    int index; // index of the point in the input
 };
 
-struct vertNode {
-    struct vert *v;
-    struct vertNode *prev, *next; // TODO: make more memory efficient ex. xor linked list
+// Coordinate range of a point set, for the error bounds of the predicates
+struct range {
+    dtreal minx, maxx, miny, maxy;
 };
 
+// Sort key of a point, see sortVerts
+struct sortKey {
+    uint64_t x; // bit pattern of the x-coordinate, mapped so that unsigned order is numerical order
+    int index; // index of the point
+};
+
+// Guibas-Stolfi quad-edge structure stored in flat, index-based arrays.
+// Quad-edge q is made of the four directed edges 4q + r, r = 0..3:
+// 4q and 4q + 2 are a primal edge and its reverse (Sym), 
+// 4q + 1 and 4q + 3 are the corresponding dual edges (Rot).
+struct qeMesh {
+    int *next; // [4 * cap] the Onext ring of every directed edge
+    int *org; // [2 * cap] origin vertex (index into v) of every primal directed edge, -1 if the quad-edge is unused
+    int nquads; // number of quad-edge slots in use by the current triangulation
+    int cap; // number of quad-edges the arrays can hold
+    struct vert *v; // sorted vertices
+    struct dtFilter filter; // error bounds of the predicates for the coordinate range of v
+};
 
-static inline int INDEX(const struct vert *v, 
-                        struct dTriangulation *tri);
+// Allocates quad-edges from a range of mesh slots.
+// The sorted vertices [ia, ib] own the slots [3 * ia, 3 * (ib + 1)), 
+// which is always enough because a planar triangulation of n points has at most 3n - 6 edges.
+// This way the two halves of a point set can be triangulated in parallel without locking.
+struct qeAlloc {
+    int free; // free list of deleted quad-edges (linked through next[4q]), -1 if empty
+    int next, end; // unused slots [next, end)
+};
+
+// Buffers kept between triangulations (see dtriangulate_ws)
+struct dtWorkspace {
+    dtreal *points; // input point buffer handed out by dtws_points
+    int points_cap;
+    struct vert *v; // sorted vertices
+    int v_cap;
+    struct qeMesh mesh; // quad-edge arrays, capacity is mesh.cap
+    bool *visited; // face visit marks used by convertTris
+    int visited_cap;
+    int *triangles; // triangle output buffer, tri->triangles points here
+    int triangles_cap;
+    struct sortKey *keys; // sort keys and radix sort scratch space, 2 * npoints
+    int keys_cap;
+
+    // state of the last triangulation, used by dtriangulate_inc_ws
+    bool reusable; // true if mesh holds a triangulation of all of the points in prev_points
+    const dtreal *prev_points; // NULL for single precision points
+    int prev_npoints, prev_nfpoints;
+    int hull; // an edge whose left face is the outer face of mesh
+    int *stack; // edges waiting for the incircle test
+    int stack_cap;
+    bool *queued; // marks the quad-edges that are in stack
+    int queued_cap;
+};
+
+
+static inline int INDEX(const struct vert *v);
 static dtreal XX(const struct vert *v);
 static dtreal YY(const struct vert *v);
 
-int compareVerts(const void *a, const void *b);
+static uint64_t sortBits(dtreal x);
+static void rangeAdd(struct range *r, const dtreal *c);
+static dtreal rangeLength(const struct range *r);
+static void sortVerts(struct dtWorkspace *ws, struct dTriangulation *tri, struct range *r);
+static bool samePoints(const struct dtWorkspace *ws, const struct dTriangulation *tri);
 
-static bool ccw(const struct vert *a, 
+static bool ccw(const struct qeMesh *m, 
+                const struct vert *a, 
                 const struct vert *b, 
                 const struct vert *c);
-static bool rightOf(const struct vert *x, 
-                    const struct vert *ea, 
-                    const struct vert *eb);
-static bool leftOf(const struct vert *x, 
-                   const struct vert *ea, 
-                   const struct vert *eb);
-static bool inCircle(const struct vert *a, 
+static bool inCircle(const struct qeMesh *m, 
+                     const struct vert *a, 
                      const struct vert *b, 
                      const struct vert *c, 
                      const struct vert *d);
 
-static void deleteAdj(struct vert *v);
-
-static void insertNodeAfter(struct vertNode *n, struct vertNode *in);
-static void insertNode(struct vert *parent, struct vert *in);
-static void deleteNode(struct vert *parent, struct vert *child);
-
-static void connectVerts(struct vert *a, struct vert *b);
-static void cutVerts(struct vert *a, struct vert *b);
-
-static struct vert *first(const struct vert *vi);
-static struct vert *pred(const struct vert *vi, 
-                         const struct vert *vj);
-static struct vert *succ(const struct vert *vi, 
-                         const struct vert *vj);
-
-static void lct(struct vert *lrightmost, 
-                struct vert *rleftmost, 
-                struct vert **lctleft, 
-                struct vert **lctright);
-
-static void uct(struct vert *lrightmost, 
-                struct vert *rleftmost, 
-                struct vert **uctleft, 
-                struct vert **uctright);
-
-static void ord_dtriangulate(struct vert *v, 
+// Edge algebra
+static int rot(int e);
+static int invRot(int e);
+static int sym(int e);
+static int onext(const struct qeMesh *m, int e);
+static int oprev(const struct qeMesh *m, int e);
+static int lnext(const struct qeMesh *m, int e);
+static int rprev(const struct qeMesh *m, int e);
+static struct vert *org(const struct qeMesh *m, int e);
+static struct vert *dest(const struct qeMesh *m, int e);
+
+static bool rightOf(const struct qeMesh *m, const struct vert *x, int e);
+static bool leftOf(const struct qeMesh *m, const struct vert *x, int e);
+
+static void *growBuffer(void *buf, int *cap, int n, size_t size);
+
+// Topological operators
+static void resetMesh(struct qeMesh *m, struct vert *v, int nquads);
+static void joinAlloc(struct qeMesh *m, struct qeAlloc *a, const struct qeAlloc *b);
+static int makeEdge(struct qeMesh *m, struct qeAlloc *al, int a, int b);
+static void splice(struct qeMesh *m, int a, int b);
+static int connect(struct qeMesh *m, struct qeAlloc *al, int a, int b);
+static void deleteEdge(struct qeMesh *m, struct qeAlloc *al, int e);
+static void swap(struct qeMesh *m, int e);
+
+static void ord_dtriangulate(struct qeMesh *m, 
+                             struct qeAlloc *al, 
                              int ia, 
                              int ib, 
-                             struct vert **leftmost, 
-                             struct vert **rightmost);
+                             int *le, 
+                             int *re);
 
-// We are not liable for any lethal or non-lethal harm caused to you by this function. 
-// Be warned.
-static void convertTrisFreeAdj(struct vert *v, struct dTriangulation *tri);
+static bool repairTris(struct dtWorkspace *ws, struct dTriangulation *tri);
+static void convertTris(struct dtWorkspace *ws, struct dTriangulation *tri);
 
-static inline int INDEX(const struct vert *v, struct dTriangulation *tri) {
-    return (v->coord - tri->points) / 2;
+static inline int INDEX(const struct vert *v) {
+    return v->index;
 }
 
 static inline dtreal XX(const struct vert *v) {
@@ -111,307 +177,368 @@ static inline dtreal YY(const struct vert *v) {;
 }
 
 
-// lexicographically compares the coordinates of the given vertices
-int compareVerts(const void *a, const void *b) {
-    dtreal diff = XX((const struct vert*)a) - XX((const struct vert*)b);
+// Maps a coordinate to an unsigned integer with the same ordering.
+// Positive floats already compare like their bit patterns, so only the sign bit needs to be set.
+// Negative floats compare in reverse, so all of their bits are flipped.
+static inline uint64_t sortBits(dtreal x) {
+    double d = x + 0.0; // turns -0 into +0, so that the two zeros are equal
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return (u >> 63) ? ~u : (u | ((uint64_t)1 << 63));
+}
+
+static inline void rangeAdd(struct range *r, const dtreal *c) {
+    r->minx = c[0] < r->minx ? c[0] : r->minx;
+    r->maxx = c[0] > r->maxx ? c[0] : r->maxx;
+    r->miny = c[1] < r->miny ? c[1] : r->miny;
+    r->maxy = c[1] > r->maxy ? c[1] : r->maxy;
+}
+
+// Returns the larger of the x and y extents of r
+static inline dtreal rangeLength(const struct range *r) {
+    return r->maxx - r->minx > r->maxy - r->miny ? r->maxx - r->minx : r->maxy - r->miny;
+}
+
+// Sorts the points of tri lexicographically, primarily by increasing x-coordinate 
+// and secondarily by increasing y-coordinate, into ws->v, and removes duplicate points 
+// (within DTEPSILON range) in the same pass. Sets tri->nverts to the number of remaining vertices
+// and r to the coordinate range of all of the points, duplicates included.
+//
+// The x-coordinates are sorted with an LSD radix sort of their bit patterns, 
+// skipping the digits that are the same for all points (ex. the sign and exponent of points in a small box), 
+// which are found up front so that no histogram is counted for them.
+// Runs of equal x are then put in order of y with an insertion sort, as they are usually short.
+static void sortVerts(struct dtWorkspace *ws, struct dTriangulation *tri, struct range *r) {
+    int n = tri->npoints;
+    struct sortKey *keys = ws->keys = (struct sortKey*)growBuffer(ws->keys, &(ws->keys_cap), 2 * n, sizeof(struct sortKey));
+    struct sortKey *tmp = keys + n;
+    dtreal c[2];
+
+    dtpoint(tri, 0, c);
+    r->minx = r->maxx = c[0];
+    r->miny = r->maxy = c[1];
+    for(int i = 0; i < n; ++i) {
+        dtpoint(tri, i, c);
+        rangeAdd(r, c);
+        keys[i].x = sortBits(c[0]);
+        keys[i].index = i;
+    }
+
+    if(n >= RADIXCUTOFF) {
+        // digits that are not the same for all points
+        uint64_t diff = 0;
+        for(int i = 1; i < n; ++i)
+            diff |= keys[i].x ^ keys[0].x;
+        int digits[RADIXPASSES], ndigits = 0;
+        for(int d = 0; d < RADIXPASSES; ++d)
+            if((diff >> (d * RADIXBITS)) & ((1 << RADIXBITS) - 1))
+                digits[ndigits++] = d;
+
+        // histogram of each of those digits, all in one pass
+        int count[RADIXPASSES][1 << RADIXBITS];
+        memset(count, 0, ndigits * sizeof(count[0]));
+
+        for(int i = 0; i < n; ++i) {
+            uint64_t x = keys[i].x;
+            for(int k = 0; k < ndigits; ++k)
+                ++count[k][(x >> (digits[k] * RADIXBITS)) & ((1 << RADIXBITS) - 1)];
+        }
+
+        for(int k = 0; k < ndigits; ++k) {
+            int shift = digits[k] * RADIXBITS;
+
+            // turn the counts into bucket offsets
+            int sum = 0;
+            for(int b = 0; b < (1 << RADIXBITS); ++b) {
+                int c = count[k][b];
+                count[k][b] = sum;
+                sum += c;
+            }
+
+            for(int i = 0; i < n; ++i)
+                tmp[count[k][(keys[i].x >> shift) & ((1 << RADIXBITS) - 1)]++] = keys[i];
 
-    if(diff < DTEPSILON && diff > -DTEPSILON) {
-        diff = YY((const struct vert*)a) - YY((const struct vert*)b);
+            struct sortKey *swp = keys;
+            keys = tmp;
+            tmp = swp;
+        }
+    }
+    else { // few points, sort by x directly
+        for(int i = 1; i < n; ++i) {
+            struct sortKey k = keys[i];
+            int j = i;
+            for(; j > 0 && keys[j-1].x > k.x; --j)
+                keys[j] = keys[j-1];
+            keys[j] = k;
+        }
     }
 
-    return (1 - 2 * signbit(diff));
+    // Order runs of equal x by y, then copy the vertices to ws->v without duplicates
+    struct vert *v = ws->v = (struct vert*)growBuffer(ws->v, &(ws->v_cap), n, sizeof(struct vert));
+    tri->nverts = 0;
+
+    for(int run = 0; run < n; ) {
+        int end = run + 1;
+        while(end < n && keys[end].x == keys[run].x)
+            ++end;
+
+        for(int i = run + 1; i < end; ++i) {
+            struct sortKey k = keys[i];
+            dtreal kc[2], jc[2];
+            dtpoint(tri, k.index, kc);
+            int j = i;
+            for(; j > run; --j) {
+                dtpoint(tri, keys[j-1].index, jc);
+                if(jc[1] <= kc[1])
+                    break;
+                keys[j] = keys[j-1];
+            }
+            keys[j] = k;
+        }
+
+        for(int i = run; i < end; ++i) {
+            dtpoint(tri, keys[i].index, c);
+            if(tri->nverts > 0) {
+                dtreal diffx = c[0] - XX(&v[tri->nverts - 1]);
+                dtreal diffy = c[1] - YY(&v[tri->nverts - 1]);
+                if(diffx < DTEPSILON && diffx > -DTEPSILON
+                    && diffy < DTEPSILON && diffy > -DTEPSILON)
+                    continue; // duplicate
+            }
+            v[tri->nverts].coord[0] = c[0];
+            v[tri->nverts].coord[1] = c[1];
+            v[tri->nverts++].index = keys[i].index;
+        }
+
+        run = end;
+    }
 }
 
 
-static inline bool ccw(const struct vert *a, 
+static inline bool ccw(const struct qeMesh *m, 
+                       const struct vert *a, 
                        const struct vert *b, 
                        const struct vert *c) {
-    // dtreal xa = XX(a);
-    // dtreal ya = YY(a);
-    // dtreal xb = XX(b);
-    // dtreal yb = YY(b);
-    // dtreal xc = XX(c);
-    // dtreal yc = YY(c);
+    return dtorient2d(&(m->filter), a->coord, b->coord, c->coord) > 0.0;
+}
 
-    // return (xa * (yb - yc) - ya * (xb - xc) + xb * yc - yb * xc) > DTEPSILON;
+// true if d is inside the circle through a, b and c (which must be in counterclockwise order)
+static inline bool inCircle(const struct qeMesh *m, 
+                            const struct vert *a, 
+                            const struct vert *b, 
+                            const struct vert *c, 
+                            const struct vert *d) {
+    return dtincircle(&(m->filter), a->coord, b->coord, c->coord, d->coord) > 0.0;
+}
 
-    return orient2d(a->coord, b->coord, c->coord) > 0.0;
+
+static inline int rot(int e) {
+    return (e & ~3) | ((e + 1) & 3);
 }
 
-static inline bool rightOf(const struct vert *x, 
-                           const struct vert *ea, 
-                           const struct vert *eb) {
-    return ccw(x, eb, ea);
+static inline int invRot(int e) {
+    return (e & ~3) | ((e + 3) & 3);
 }
 
-static inline bool leftOf(const struct vert *x, 
-                          const struct vert *ea, 
-                          const struct vert *eb) {
-    return ccw(x, ea, eb);
+static inline int sym(int e) {
+    return e ^ 2;
 }
 
-static inline bool inCircle(const struct vert *a, 
-                            const struct vert *b, 
-                            const struct vert *c, 
-                            const struct vert *d) {
-    // Acknowledgments:
-    // Baker, M. (2015). Maths - Matrix algebra - Determinants 4D.
-    // http://www.euclideanspace.com/maths/algebra/matrix/functions/determinant/fourD/index.htm
-
-    // dtreal m[4][3] = {
-    //  {XX(a), YY(a)},
-    //  {XX(b), YY(b)},
-    //  {XX(c), YY(c)},
-    //  {XX(d), YY(d)}
-    // };
-    // m[0][2] = m[0][0] * m[0][0] + m[0][1] * m[0][1];
-    // m[1][2] = m[1][0] * m[1][0] + m[1][1] * m[1][1];
-    // m[2][2] = m[2][0] * m[2][0] + m[2][1] * m[2][1];
-    // m[3][2] = m[3][0] * m[3][0] + m[3][1] * m[3][1];
-
-    // return (
-    // m[1][2] * m[2][1] * m[3][0] - m[0][2] * m[2][1] * m[3][0] -
-    // m[1][1] * m[2][2] * m[3][0] + m[0][1] * m[2][2] * m[3][0] +
-    // m[0][2] * m[1][1] * m[3][0] - m[0][1] * m[1][2] * m[3][0] -
-    // m[1][2] * m[2][0] * m[3][1] + m[0][2] * m[2][0] * m[3][1] +
-    // m[1][0] * m[2][2] * m[3][1] - m[0][0] * m[2][2] * m[3][1] -
-    // m[0][2] * m[1][0] * m[3][1] + m[0][0] * m[1][2] * m[3][1] +
-    // m[1][1] * m[2][0] * m[3][2] - m[0][1] * m[2][0] * m[3][2] -
-    // m[1][0] * m[2][1] * m[3][2] + m[0][0] * m[2][1] * m[3][2] +
-    // m[0][1] * m[1][0] * m[3][2] - m[0][0] * m[1][1] * m[3][2] -
-    // m[0][2] * m[1][1] * m[2][0] + m[0][1] * m[1][2] * m[2][0] +
-    // m[0][2] * m[1][0] * m[2][1] - m[0][0] * m[1][2] * m[2][1] -
-    // m[0][1] * m[1][0] * m[2][2] + m[0][0] * m[1][1] * m[2][2]) > DTEPSILON;
-
-    return incircle(a->coord, b->coord, c->coord, d->coord) > 0.0;
-}
-
-
-static void deleteAdj(struct vert *v) {
-    struct vertNode *vn = v->adj, *prev;
-    if(vn) {
-        do {
-            prev = vn;
-            vn = vn->next;
-            free(prev);
-        } while(vn != v->adj);
-        v->adj = NULL;
-    }
+static inline int onext(const struct qeMesh *m, int e) {
+    return m->next[e];
 }
 
-static inline void insertNodeAfter(struct vertNode *n, struct vertNode *in) {
-    struct vertNode *temp = n->next;
-    n->next = in;
-    temp->prev = in;
-    in->prev = n;
-    in->next = temp;
+static inline int oprev(const struct qeMesh *m, int e) {
+    return rot(m->next[rot(e)]);
 }
 
-static void insertNode(struct vert *parent, struct vert *in) {
-    struct vertNode *vn = (struct vertNode*)malloc(sizeof(struct vertNode));
-    vn->v = in;
+static inline int lnext(const struct qeMesh *m, int e) {
+    return rot(m->next[invRot(e)]);
+}
 
-    if(parent->adj) { // if parent already has neighbors, then insert in proper position
-        struct vertNode *cur, *temp;
-        if(rightOf(in, parent, parent->adj->v)) {
-            cur = parent->adj->prev;
-            while(cur != parent->adj && rightOf(in, parent, cur->v)) {
-                cur = cur->prev;
-            }
-            if(cur == parent->adj) { // then in-vertex is convex hull successor of parent
-                parent->adj = vn; // so make in-vertex "first"
-                insertNodeAfter(cur->prev, vn);
-            }
-            else {
-                insertNodeAfter(cur, vn);
-            }
-        }
-        else {
-            cur = parent->adj->next;
-            while(cur != parent->adj && leftOf(in, parent, cur->v)) {
-                cur = cur->next;
-            }
+static inline int rprev(const struct qeMesh *m, int e) {
+    return m->next[sym(e)];
+}
 
-            if(cur->v == in)
-                return; // don't insert duplicate vert
-            insertNodeAfter(cur->prev, vn);
-        }
-    }
-    else { // if parent has no neighbors, add this node and make it a circular list
-        parent->adj = vn;
-        vn->prev = vn;
-        vn->next = vn;
-    }
+static inline struct vert *org(const struct qeMesh *m, int e) {
+    return &(m->v[m->org[e >> 1]]);
 }
 
-static void deleteNode(struct vert *parent, struct vert *child) {
-    struct vertNode *vn = parent->adj;
-    if(vn) {
-        do {
-            if(vn->v == child) {
-                vn->prev->next = vn->next;
-                vn->next->prev = vn->prev;
-                if(vn == parent->adj) {
-                    if(vn->next == vn) { // there was only one node in list
-                        parent->adj = NULL; // so now there will be zero
-                    }
-                    else {
-                        parent->adj = vn->next;
-                    }
-                }
-                free(vn);
-                break;
-            }
-            vn = vn->next;
-        } while(vn && vn != parent->adj);
-    }
+static inline struct vert *dest(const struct qeMesh *m, int e) {
+    return &(m->v[m->org[sym(e) >> 1]]);
 }
 
-static void connectVerts(struct vert *a, struct vert *b) {
-    if(a && b && a != b) {
-        insertNode(a, b);
-        insertNode(b, a);
-    }
+static inline bool rightOf(const struct qeMesh *m, const struct vert *x, int e) {
+    return ccw(m, x, dest(m, e), org(m, e));
 }
 
-static void cutVerts(struct vert *a, struct vert *b) {
-    if(a && b && a != b) {
-        deleteNode(a, b);
-        deleteNode(b, a);
-    }
+static inline bool leftOf(const struct qeMesh *m, const struct vert *x, int e) {
+    return ccw(m, x, org(m, e), dest(m, e));
 }
 
 
-static inline struct vert *first(const struct vert *vi) {
-    if(vi && vi->adj)
-        return vi->adj->v;
-    return NULL;
+// Makes sure buf can hold n elements of the given size. 
+// The old contents are not kept if the buffer has to grow.
+static void *growBuffer(void *buf, int *cap, int n, size_t size) {
+    if(n > *cap) {
+        free(buf);
+        buf = malloc(n * size);
+        *cap = n;
+    }
+    return buf;
 }
 
-static struct vert *pred(const struct vert *vi, 
-                         const struct vert *vj) {
-    if(vi && vj) {
-        struct vertNode *vn = vi->adj;
-        if(vn) {
-            do {
-                if(vn->v == vj) {
-                    if(vn->prev)
-                        return vn->prev->v;
-                    return NULL;
-                }
-                vn = vn->prev;
-            } while(vn && vn != vi->adj);
-        }
+// Empties the mesh and makes room for nquads quad-edges
+static void resetMesh(struct qeMesh *m, struct vert *v, int nquads) {
+    if(nquads > m->cap) {
+        free(m->next);
+        free(m->org);
+        m->next = (int*)malloc(4 * nquads * sizeof(int));
+        m->org = (int*)malloc(2 * nquads * sizeof(int));
+        m->cap = nquads;
     }
-    else {
-        fprintf(stderr, 
-            "Hey silly, you input null vertices in predecessor function!\n");
+    memset(m->org, -1, 2 * nquads * sizeof(int));
+    m->nquads = nquads;
+    m->v = v;
+}
+
+// Gives all of the free slots of allocator b to allocator a. 
+// Used once both halves of a parallel triangulation are done.
+static void joinAlloc(struct qeMesh *m, struct qeAlloc *a, const struct qeAlloc *b) {
+    for(int q = b->next; q < b->end; ++q) {
+        m->next[4 * q] = a->free;
+        a->free = q;
     }
-    return NULL;
-}
-
-static struct vert *succ(const struct vert *vi, 
-                         const struct vert *vj) {
-    if(vi && vj) {
-        struct vertNode *vn = vi->adj;
-        if(vn) {
-            do {
-                if(vn->v == vj) {
-                    if(vn->next)
-                        return vn->next->v;
-                    return NULL;
-                }
-                vn = vn->next;
-            } while(vn && vn != vi->adj);
-        }
+    if(b->free >= 0) {
+        int tail = b->free;
+        while(m->next[4 * tail] >= 0)
+            tail = m->next[4 * tail];
+        m->next[4 * tail] = a->free;
+        a->free = b->free;
+    }
+}
+
+// Creates a new edge from vertex a to vertex b (indexes into m->v) and returns it
+static int makeEdge(struct qeMesh *m, struct qeAlloc *al, int a, int b) {
+    int q;
+    if(al->free >= 0) { // reuse a deleted quad-edge
+        q = al->free;
+        al->free = m->next[4 * q];
     }
     else {
-        fprintf(stderr, 
-            "Hey silly, you input null vertices in successor function!\n");
+        q = al->next++;
     }
-    return NULL;
+
+    gta_count(GTA_C_EDGES, 1);
+
+    int e = 4 * q;
+    m->next[e] = e;
+    m->next[e + 1] = e + 3;
+    m->next[e + 2] = e + 2;
+    m->next[e + 3] = e + 1;
+    m->org[e >> 1] = a;
+    m->org[(e + 2) >> 1] = b;
+    return e;
 }
 
+static void splice(struct qeMesh *m, int a, int b) {
+    int alpha = rot(m->next[a]);
+    int beta = rot(m->next[b]);
 
-// Lower common tangent of two convex hulls
-static void lct(struct vert *lrightmost, 
-                struct vert *rleftmost, 
-                struct vert **lctleft, 
-                struct vert **lctright) {
-    struct vert *x = lrightmost;
-    struct vert *y = rleftmost;
-    struct vert *rfast = first(y);
-    struct vert *lfast = NULL;
+    int t1 = m->next[b];
+    int t2 = m->next[a];
+    int t3 = m->next[beta];
+    int t4 = m->next[alpha];
 
-    struct vert *fx = first(x);
-    if(fx) {
-        lfast = pred(x, fx);
-    }
-    
-    struct vert *temp;
-
-    while(true) {
-        if(rfast && rightOf(rfast, x, y)) {
-            temp = rfast;
-            rfast = succ(rfast, y);
-            y = temp;
-        }
-        else if(lfast && rightOf(lfast, x, y)) {
-            temp = lfast;
-            lfast = pred(lfast, x);
-            x = temp;
-        }
-        else {
-            *lctleft = x;
-            *lctright = y;
-            break;
-        }
-    }
+    m->next[a] = t1;
+    m->next[b] = t2;
+    m->next[alpha] = t3;
+    m->next[beta] = t4;
 }
 
-// Upper common tangent of two convex hulls
-static void uct(struct vert *lrightmost, 
-                struct vert *rleftmost, 
-                struct vert **uctleft, 
-                struct vert **uctright) {
-    struct vert *x = lrightmost;
-    struct vert *y = rleftmost;
-    struct vert *lfast = first(x);
-    struct vert *rfast = NULL;
+// Adds a new edge from the destination of a to the origin of b,
+// such that a, the new edge and b all have the same left face
+static int connect(struct qeMesh *m, struct qeAlloc *al, int a, int b) {
+    int e = makeEdge(m, al, m->org[sym(a) >> 1], m->org[b >> 1]);
+    splice(m, e, lnext(m, a));
+    splice(m, sym(e), b);
+    return e;
+}
 
-    struct vert *fy = first(y);
-    if(fy) {
-        rfast = pred(y, first(y));
-    }
+static void deleteEdge(struct qeMesh *m, struct qeAlloc *al, int e) {
+    splice(m, e, oprev(m, e));
+    splice(m, sym(e), oprev(m, sym(e)));
 
-    struct vert *temp;
+    int q = e >> 2;
+    m->org[(4 * q) >> 1] = -1;
+    m->org[(4 * q + 2) >> 1] = -1;
+    m->next[4 * q] = al->free;
+    al->free = q;
+}
 
-    while(true) {
-        if(rfast && leftOf(rfast, x, y)) {
-            temp = rfast;
-            rfast = pred(rfast, y);
-            y = temp;
-        }
-        else if(lfast && leftOf(lfast, x, y)) {
-            temp = lfast;
-            lfast = succ(lfast, x);
-            x = temp;
-        }
-        else {
-            *uctleft = x;
-            *uctright = y;
-            break;
-        }
-    }
+// Flips edge e, which must be the diagonal of two triangles forming a convex quadrilateral, 
+// so that it connects the other two corners of the quadrilateral
+static void swap(struct qeMesh *m, int e) {
+    int a = oprev(m, e);
+    int b = oprev(m, sym(e));
+
+    splice(m, e, a);
+    splice(m, sym(e), b);
+    splice(m, e, lnext(m, a));
+    splice(m, sym(e), lnext(m, b));
+
+    m->org[e >> 1] = m->org[sym(a) >> 1];
+    m->org[sym(e) >> 1] = m->org[sym(b) >> 1];
 }
 
 
+// exactinit only computes constants, but must not run while another thread is using them
+static pthread_once_t exact_once = PTHREAD_ONCE_INIT;
+
 void dtinit() {
-    exactinit();
+    pthread_once(&exact_once, exactinit);
+}
+
+struct dtWorkspace *dtws_new() {
+    struct dtWorkspace *ws = (struct dtWorkspace*)calloc(1, sizeof(struct dtWorkspace));
+    return ws;
+}
+
+void dtws_free(struct dtWorkspace *ws) {
+    free(ws->points);
+    free(ws->v);
+    free(ws->mesh.next);
+    free(ws->mesh.org);
+    free(ws->visited);
+    free(ws->triangles);
+    free(ws->keys);
+    free(ws->stack);
+    free(ws->queued);
+    free(ws);
+}
+
+dtreal *dtws_points(struct dtWorkspace *ws, int npoints) {
+    ws->points = (dtreal*)growBuffer(ws->points, &(ws->points_cap), npoints, 2 * sizeof(dtreal));
+    return ws->points;
 }
 
 void dtriangulate(struct dTriangulation *tri) {
-    // static int iter = 0;
+    struct dtWorkspace *ws = dtws_new();
+
+    dtriangulate_ws(tri, ws);
+
+    // hand the triangle buffer over to the caller
+    if(tri->triangles) {
+        tri->triangles = realloc(ws->triangles, 3 * tri->ntriangles * sizeof(int)); // shrink memory if needed
+        ws->triangles = NULL;
+    }
+    dtws_free(ws);
+}
+
+void dtriangulate_ws(struct dTriangulation *tri, struct dtWorkspace *ws) {
+    tri->triangles = NULL;
+    tri->ntriangles = 0;
+    ws->reusable = false;
 
     if(tri->npoints < MINPOINTS) {
         fprintf(stderr, 
@@ -420,217 +547,333 @@ void dtriangulate(struct dTriangulation *tri) {
         return;
     }
 
-    // construct vertex structures of points
-    // TODO: sort indexes instead of vert structs (less memory movement),
-    // then remove indexes with duplicate coordinates,
-    // then construct verts!
-    // (test performance difference)
-    struct vert *v = (struct vert*)malloc(tri->npoints * sizeof(struct vert));
-
-    for(int i = 0; i < tri->npoints; ++i) {
-        v[i].coord = tri->points + 2*i;
-        v[i].adj = NULL;
-    }
-
-    // sort vertices lexicographically by point coordinates
-    qsort(v, tri->npoints, sizeof(struct vert), compareVerts);
-
-    // remove duplicate points! (within DTEPSILON range)
-    // TODO: test!
-    tri->nverts = tri->npoints;
-    for(int i = 1; i < tri->nverts; ) {
-        dtreal diffx = XX(&v[i]) - XX(&v[i-1]);
-        dtreal diffy = YY(&v[i]) - YY(&v[i-1]);
-        if(diffx < DTEPSILON && diffx > -DTEPSILON
-            && diffy < DTEPSILON && diffy > -DTEPSILON) {
-            memmove(v + i, v + i + 1, tri->nverts - i + 1);
-            --(tri->nverts);
-        }
-        else {
-            ++i;
-        }
-    }
+    // sort vertices lexicographically by point coordinates and remove duplicate points
+    double start = gta_tic();
+    struct range r;
+    sortVerts(ws, tri, &r);
+    struct vert *v = ws->v;
+    gta_toc(GTA_T_SORT, start);
+    gta_count(GTA_C_DUPLICATES, tri->npoints - tri->nverts);
 
     if(tri->nverts < MINPOINTS) {
         fprintf(stderr, 
             "TRIANGULATION ERROR: Only %d non-duplicate points? That's not enough!\n", 
             tri->nverts);
-        free(v);
         return;
     }
 
-    // DEBUG
-    // FILE *f = fopen("points.txt", "w");
-
-    // for(int i = 0; i < tri->nverts; ++i) {
-    //  fprintf(f, "%f, %f\n", XX(&v[i]), YY(&v[i]));
-    // }
-
-    // fclose(f);
-
-    // if(inCircle(&v[0], &v[1], &v[2], &v[3])) {
-    //  printf("In circle!\n");
-    // }
-    // else {
-    //  printf("Not in circle!\n");
-    // }
-    //
-
-    // triangulate the sorted points
-    struct vert *l, *r;
-    ord_dtriangulate(v, 0, tri->nverts - 1, &l, &r);
-
-    // DEBUG
-    // if(iter == 0) {
-    //  FILE *f = fopen("adj.txt", "w");
-
-    //  for(int i = 0; i < tri->nverts; ++i) {
-    //      fprintf(f, "%f, %f: ", XX(&v[i]), YY(&v[i]));
-    //      if(v[i].adj) {
-    //          struct vertNode *n = v[i].adj;
-    //          do {
-    //              fprintf(f, "%f, %f; ", XX(n->v), YY(n->v));
-    //              n = n->next;
-    //          } while(n && n != v[i].adj);
-    //          fprintf(f, "\n");
-    //      }
-    //  }
-
-    //  fclose(f);
-    // }
-    // ++iter;
-    //
+    // triangulate the sorted points.
+    // A planar triangulation has at most 3n - 6 edges, and deleted edges are reused,
+    // so the mesh never needs more than 3n quad-edges
+    resetMesh(&(ws->mesh), v, 3 * tri->nverts);
+    dtfilter_init(&(ws->mesh.filter), rangeLength(&r));
+    struct qeAlloc al = {-1, 0, 3 * tri->nverts};
+
+    int le, re;
+    start = gta_tic();
+#ifdef _OPENMP
+    if(tri->nverts >= TASKCUTOFF && !omp_in_parallel() && omp_get_max_threads() > 1) {
+        // Not called from a parallel region (ex. a single large frame), 
+        // so start a team of threads to triangulate the two halves of the point set in parallel.
+        // Inside a parallel region, the tasks are picked up by the threads of the enclosing team instead.
+#pragma omp parallel
+#pragma omp single
+        ord_dtriangulate(&(ws->mesh), &al, 0, tri->nverts - 1, &le, &re);
+    }
+    else
+#endif
+    ord_dtriangulate(&(ws->mesh), &al, 0, tri->nverts - 1, &le, &re);
+    gta_toc(GTA_T_MERGE, start);
 
     // convert the triangulation into triangle list and store in tri->triangles
-    convertTrisFreeAdj(v, tri);
-    free(v);
+    start = gta_tic();
+    convertTris(ws, tri);
+    gta_toc(GTA_T_CONVERT, start);
+
+    // the mesh can only be repaired later if it contains every point
+    ws->reusable = tri->nverts == tri->npoints && tri->ntriangles > 0;
+    ws->prev_points = tri->points;
+    ws->prev_npoints = tri->npoints;
+    ws->prev_nfpoints = tri->points ? 0 : tri->nfpoints;
+    ws->hull = sym(le);
+}
+
+// true if tri has the points of the last triangulation of ws, see dtriangulate_inc_ws
+static inline bool samePoints(const struct dtWorkspace *ws, const struct dTriangulation *tri) {
+    if(tri->npoints != ws->prev_npoints)
+        return false;
+    if(tri->points)
+        return tri->points == ws->prev_points;
+    return ws->prev_points == NULL && tri->nfpoints == ws->prev_nfpoints;
+}
+
+int dtriangulate_inc_ws(struct dTriangulation *tri, struct dtWorkspace *ws) {
+    if(ws->reusable && samePoints(ws, tri)) {
+        tri->nverts = tri->npoints;
+        double start = gta_tic();
+        bool repaired = repairTris(ws, tri);
+        gta_toc(GTA_T_REPAIR, start);
+        if(repaired) {
+            start = gta_tic();
+            convertTris(ws, tri);
+            gta_toc(GTA_T_CONVERT, start);
+            return 1;
+        }
+    }
+
+    dtriangulate_ws(tri, ws);
+    return 0;
 }
 
 // triangulates given vertices assuming that they are lexicographically ordered
-// primarily by increasing x-coordinate and secondarily by increasing y-coordinate
-static void ord_dtriangulate(struct vert *v, 
+// primarily by increasing x-coordinate and secondarily by increasing y-coordinate.
+// le is the counterclockwise convex hull edge out of the leftmost vertex,
+// and re is the clockwise convex hull edge out of the rightmost vertex.
+//
+// If there are at least TASKCUTOFF points, the two halves are triangulated in parallel as OpenMP tasks.
+// Each half then gets its own quad-edge allocator for its range of mesh slots (see struct qeAlloc).
+static void ord_dtriangulate(struct qeMesh *m, 
+                             struct qeAlloc *al, 
                              int ia, 
                              int ib, 
-                             struct vert **leftmost, 
-                             struct vert **rightmost) {
+                             int *le, 
+                             int *re) {
+    struct vert *v = m->v;
+
     if(ib - ia == 1) {
         // num points = 2. Handle this base case
-        connectVerts(&v[ia], &v[ib]);
-        *leftmost = &v[ia];
-        *rightmost = &v[ib];
+        int a = makeEdge(m, al, ia, ib);
+        *le = a;
+        *re = sym(a);
     }
     else if(ib - ia == 2) {
         // num points = 3. Handle this base case
-        connectVerts(&v[ia], &v[ia + 1]);
-        connectVerts(&v[ia + 1], &v[ib]);
-        if(ccw(&v[ia], &v[ia + 1], &v[ib]) || ccw(&v[ia], &v[ib], &v[ia + 1])) {
-            connectVerts(&v[ia], &v[ib]);
-        } // else, the three points are collinear, so don't connect the first and third point
-        *leftmost = &v[ia];
-        *rightmost = &v[ib];
+        int a = makeEdge(m, al, ia, ia + 1);
+        int b = makeEdge(m, al, ia + 1, ib);
+        splice(m, sym(a), b);
+
+        if(ccw(m, &v[ia], &v[ia + 1], &v[ib])) {
+            connect(m, al, b, a);
+            *le = a;
+            *re = sym(b);
+        }
+        else if(ccw(m, &v[ia], &v[ib], &v[ia + 1])) {
+            int c = connect(m, al, b, a);
+            *le = sym(c);
+            *re = c;
+        }
+        else { // the three points are collinear, so don't connect the first and third point
+            *le = a;
+            *re = sym(b);
+        }
     }
     else if(ib - ia >= 3) { // num points >= 4
-        struct vert *lo, *li, *ri, *ro;
-        struct vert *lctl, *lctr, *uctl, *uctr;
+        int ldo, ldi, rdi, rdo;
         int mid = (ia + ib) / 2;
 
         // triangulate two halves of point set
-        ord_dtriangulate(v, ia, mid, &lo, &li);
-        ord_dtriangulate(v, mid + 1, ib, &ri, &ro);
-
-        // get lower and upper common tangents between the two halves
-        lct(li, ri, &lctl, &lctr);
-        uct(li, ri, &uctl, &uctr); // TODO: remove upper common tangent calculation, 
-        // and just stop merge loop when next candidates are below the line of the current base
-        // (ie rightOf(cand, li, ri))
-
-        // merge the two halves
-        li = lctl;
-        ri = lctr;
-        bool a, b;
-        struct vert *l1, *l2, *r1, *r2;
-        while(li != uctl || ri != uctr) { // connect from bottom to top
-            a = false, b = false;
-            connectVerts(li, ri);
-
-            r1 = pred(ri, li);
-            if(leftOf(r1, li, ri)) {
-                r2 = pred(ri, r1);
-                while(inCircle(r1, li, ri, r2)) {
-                    cutVerts(ri, r1);
-                    r1 = r2;
-                    r2 = pred(ri, r1);
-                }
+        if(ib - ia + 1 >= TASKCUTOFF) {
+            // al is untouched here, since all larger subproblems were split the same way
+            struct qeAlloc ral = {-1, 3 * (mid + 1), al->end};
+            al->end = 3 * (mid + 1);
+
+#pragma omp task shared(m,al,ldo,ldi) firstprivate(ia,mid)
+            ord_dtriangulate(m, al, ia, mid, &ldo, &ldi);
+
+            ord_dtriangulate(m, &ral, mid + 1, ib, &rdi, &rdo);
+
+#pragma omp taskwait
+            joinAlloc(m, al, &ral);
+        }
+        else {
+            ord_dtriangulate(m, al, ia, mid, &ldo, &ldi);
+            ord_dtriangulate(m, al, mid + 1, ib, &rdi, &rdo);
+        }
+
+        // get lower common tangent of the two halves
+        while(true) {
+            if(leftOf(m, org(m, rdi), ldi)) {
+                ldi = lnext(m, ldi);
+            }
+            else if(rightOf(m, org(m, ldi), rdi)) {
+                rdi = rprev(m, rdi);
             }
             else {
-                a = true;
+                break;
             }
+        }
 
-            l1 = succ(li, ri);
-            if(rightOf(l1, ri, li)) {
-                l2 = succ(li, l1);
-                while(inCircle(li, ri, l1, l2)) {
-                    cutVerts(li, l1);
-                    l1 = l2;
-                    l2 = succ(li, l1);
+        // merge the two halves from bottom to top, starting with the lower common tangent
+        int basel = connect(m, al, sym(rdi), ldi);
+        if(org(m, ldi) == org(m, ldo))
+            ldo = sym(basel);
+        if(org(m, rdi) == org(m, rdo))
+            rdo = basel;
+
+        int lcand, rcand, t;
+        bool lvalid, rvalid;
+        while(true) {
+            // delete left candidate edges that fail the circle test
+            lcand = onext(m, sym(basel));
+            if((lvalid = rightOf(m, dest(m, lcand), basel))) {
+                while(inCircle(m, dest(m, basel), org(m, basel), dest(m, lcand), dest(m, onext(m, lcand)))) {
+                    t = onext(m, lcand);
+                    deleteEdge(m, al, lcand);
+                    lcand = t;
                 }
             }
-            else {
-                b = true;
-            }
 
-            if(a) {
-                li = l1;
-            }
-            else if(b) {
-                ri = r1;
+            // same for the right candidate
+            rcand = oprev(m, basel);
+            if((rvalid = rightOf(m, dest(m, rcand), basel))) {
+                while(inCircle(m, dest(m, basel), org(m, basel), dest(m, rcand), dest(m, oprev(m, rcand)))) {
+                    t = oprev(m, rcand);
+                    deleteEdge(m, al, rcand);
+                    rcand = t;
+                }
             }
-            else if(!inCircle(li, ri, r1, l1)) {
-                ri = r1;
+
+            if(!lvalid && !rvalid)
+                break; // basel is the upper common tangent
+
+            // connect to whichever candidate's circumcircle doesn't contain the other
+            if(!lvalid || (rvalid 
+                && inCircle(m, dest(m, lcand), org(m, lcand), org(m, rcand), dest(m, rcand)))) {
+                basel = connect(m, al, rcand, sym(basel));
             }
             else {
-                li = l1;
+                basel = connect(m, al, sym(basel), sym(lcand));
             }
         }
-        connectVerts(uctl, uctr); // connect the top
 
-        *leftmost = lo;
-        *rightmost = ro;
+        *le = ldo;
+        *re = rdo;
     }
     // else, num points <=1; invalid input so do nothing
 }
 
-// WARNING: this function frees the adj nodes of the given verts.
-// This is done to avoid using an extra variable to mark verts as "complete".
-// The enumerated triangle indexes are stored in tri->triangles.
-static void convertTrisFreeAdj(struct vert *v, struct dTriangulation *tri) {
+// Turns the triangulation in ws->mesh, whose points have moved since it was made, 
+// back into a Delaunay triangulation by flipping the edges that fail the incircle test (Lawson's algorithm).
+// Returns false, leaving the mesh in an undefined state, if the moved points no longer fit the mesh 
+// (a triangle was inverted or the convex hull changed) or if too many flips are needed.
+static bool repairTris(struct dtWorkspace *ws, struct dTriangulation *tri) {
+    struct qeMesh *m = &(ws->mesh);
+
+    // the points have moved, so fetch their new coordinates into the vertices
+    struct range r;
+    dtpoint(tri, m->v[0].index, m->v[0].coord);
+    r.minx = r.maxx = m->v[0].coord[0];
+    r.miny = r.maxy = m->v[0].coord[1];
+    for(int i = 0; i < tri->nverts; ++i) {
+        dtpoint(tri, m->v[i].index, m->v[i].coord);
+        rangeAdd(&r, m->v[i].coord);
+    }
+    dtfilter_init(&(m->filter), rangeLength(&r));
+
+    // mark the edges of the outer face, making sure it is still convex
+    bool *outer = ws->visited = (bool*)growBuffer(ws->visited, &(ws->visited_cap), 
+        2 * m->nquads, sizeof(bool));
+    memset(outer, 0, 2 * m->nquads * sizeof(bool));
+
+    int e = ws->hull;
+    do {
+        outer[e >> 1] = true;
+        // the outer face is traversed clockwise, so every turn must be to the right
+        if(ccw(m, org(m, e), dest(m, e), dest(m, lnext(m, e))))
+            return false;
+        e = lnext(m, e);
+    } while(e != ws->hull);
+
+    // make sure no triangle was inverted
+    for(e = 0; e < 4 * m->nquads; e += 2) {
+        if(m->org[e >> 1] < 0 || outer[e >> 1])
+            continue;
+        int e1 = lnext(m, e);
+        if(e < e1 && e < lnext(m, e1) // check each triangle only once
+            && !ccw(m, org(m, e), dest(m, e), dest(m, e1)))
+            return false;
+    }
+
+    // queue all interior edges for the incircle test
+    int *stack = ws->stack = (int*)growBuffer(ws->stack, &(ws->stack_cap), m->nquads, sizeof(int));
+    bool *queued = ws->queued = (bool*)growBuffer(ws->queued, &(ws->queued_cap), m->nquads, sizeof(bool));
+    int nstack = 0;
+
+    for(int q = 0; q < m->nquads; ++q) {
+        e = 4 * q;
+        queued[q] = m->org[e >> 1] >= 0 && !outer[e >> 1] && !outer[sym(e) >> 1];
+        if(queued[q])
+            stack[nstack++] = e;
+    }
+
+    // flip illegal edges until there are none left. 
+    // Flipping never touches the convex hull, so the outer face marks stay valid
+    int maxflips = MAXFLIPS * tri->nverts, nflips = 0;
+    while(nstack > 0) {
+        e = stack[--nstack];
+        queued[e >> 2] = false;
+
+        if(inCircle(m, org(m, e), dest(m, e), dest(m, lnext(m, e)), dest(m, lnext(m, sym(e))))) {
+            if(++nflips > maxflips)
+                return false;
+
+            swap(m, e);
+            gta_count(GTA_C_FLIPS, 1);
+
+            // the edges of the surrounding quadrilateral may have become illegal
+            int quad[4] = {lnext(m, e), lnext(m, lnext(m, e)), 
+                           lnext(m, sym(e)), lnext(m, lnext(m, sym(e)))};
+            for(int i = 0; i < 4; ++i) {
+                int q = quad[i] >> 2;
+                if(!queued[q] && !outer[quad[i] >> 1] && !outer[sym(quad[i]) >> 1]) {
+                    queued[q] = true;
+                    stack[nstack++] = quad[i];
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// Enumerates the triangular faces of the mesh and stores their point indexes 
+// (in counterclockwise order) in the workspace's triangle buffer, pointed to by tri->triangles.
+static void convertTris(struct dtWorkspace *ws, struct dTriangulation *tri) {
+    const struct qeMesh *m = &(ws->mesh);
     int ntri = 0;
     // 2(n-1)-k is number of triangles, n = nverts and k = num points on convex hull
     // 2 is used for k to accomodate case of two input points
-    tri->triangles = (int*)malloc(3 * (2 * (tri->nverts - 1) - 2) * sizeof(int));
-
-    struct vertNode *vn;
-    for(int i = 0; i < tri->nverts; ++i) {
-        vn = v[i].adj;
-        if(vn && vn->next != vn) {
-            do {
-                if(vn->v->adj 
-                    && vn->next->v->adj) {
-                    if(vn->next == v[i].adj && !rightOf(vn->v, &v[i], vn->next->v)) {
-                        break; // on convex hull. 
-                    }
-                    tri->triangles[3*ntri] = INDEX(&v[i], tri);
-                    tri->triangles[3*ntri+1] = INDEX(vn->v, tri);
-                    tri->triangles[3*ntri+2] = INDEX(vn->next->v, tri);
-                    ++ntri;
-                }
-                vn = vn->next;
-            } while(vn != v[i].adj);
+    tri->triangles = ws->triangles = (int*)growBuffer(ws->triangles, &(ws->triangles_cap), 
+        2 * (tri->nverts - 1) - 2, 3 * sizeof(int));
+
+    // marks the primal directed edges whose left face has been visited
+    bool *visited = ws->visited = (bool*)growBuffer(ws->visited, &(ws->visited_cap), 
+        2 * m->nquads, sizeof(bool));
+    memset(visited, 0, 2 * m->nquads * sizeof(bool));
+
+    int e1, e2, e3;
+    for(int e = 0; e < 4 * m->nquads; e += 2) {
+        if(visited[e >> 1] || m->org[e >> 1] < 0)
+            continue;
+
+        e1 = lnext(m, e);
+        e2 = lnext(m, e1);
+        e3 = lnext(m, e2);
+
+        if(e3 == e && ccw(m, org(m, e), org(m, e1), org(m, e2))) {
+            tri->triangles[3*ntri] = INDEX(org(m, e));
+            tri->triangles[3*ntri+1] = INDEX(org(m, e1));
+            tri->triangles[3*ntri+2] = INDEX(org(m, e2));
+            ++ntri;
         }
-        deleteAdj(&v[i]);
+
+        // mark every edge around this face
+        e1 = e;
+        do {
+            visited[e1 >> 1] = true;
+            e1 = lnext(m, e1);
+        } while(e1 != e);
     }
 
-    tri->triangles = realloc(tri->triangles, 3 * ntri * sizeof(int)); // shrink memory if needed
     tri->ntriangles = ntri;
 }
-
@@ -9,20 +9,49 @@
  * and including many others, as listed at http://www.gromacs.org.
  */
 
+#define _POSIX_C_SOURCE 200809L // sigaction
+
 #ifdef GTA_BENCH
 #include <time.h>
 #endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef GTA_MPI
+#include <mpi.h>
+#endif
+#include <signal.h>
+#include <string.h>
 #include "macros.h"
 #include "smalloc.h"
 
+#include "gkut_io.h"
 #include "gkut_log.h"
 
 #include "gta_grid.h"
+#include "gta_timing.h"
 #include "gta_tri.h"
 
 #define CORR_EPS 1e-12
 
-enum {efT_TRAJ, efT_NDX, efT_OUTDAT, efT_NUMFILES};
+enum {efT_TRAJ, efT_NDX, efT_OUTDAT, efT_OUTBIN, efT_MESH, efT_OUTVERT, efT_NUMFILES};
+
+// Ends a followed trajectory on the first SIGINT or SIGTERM, so that the output files are still completed.
+// A second one terminates right away.
+static void stop_following(int sig) {
+    stop_traj_streams();
+    signal(sig, SIG_DFL);
+}
+
+static void follow_signals() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_following;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; // no SA_RESTART, so that a read from a pipe is interrupted too
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
 
 int main(int argc, char *argv[]) {
 #ifdef GTA_BENCH
@@ -32,8 +61,11 @@ int main(int argc, char *argv[]) {
     const char *desc[] = {
         "g_tessla calculates 3-d surface area using Delaunay tessellation. \n",
         "It reads in a trajectory file through the -f option (supported formats=xtc,trr,pdb). \n",
+        "Frames can be selected with the usual -b, -e and -dt options, and -skip X only uses every X-th of those frames.\n",
+        "Frames that are not selected are dropped while reading, so they take no memory.\n",
         "The set of points for tessellation, such as the coordinates of phosphorous atoms in a lipid bilayer, are specified using an index file by the -n option.\n",
-        "Areas can be calculated individually for each frame in which case the output is dumped into an ASCII file specified by the -o option.\n\n",
+        "Areas can be calculated individually for each frame in which case the output is dumped into an ASCII file specified by the -o option.\n",
+        "Set -obin to also save them to a binary columnar file that can be memory-mapped (see the readme for its layout).\n\n",
         "This code can also be used for calculating the surface areas of lipid bilayers.\n", 
         "In such a calculation, the lipid bilayer normal is assumed to be parallel to the z-axis.\n",
         "This assumption is made to include in the surface area the space between the atoms lying at the periphery of the unit cell and the boundary of the unit cell.\n",
@@ -51,10 +83,41 @@ int main(int argc, char *argv[]) {
         "The tessellated surface can be visualized using the -print option. The resulting .node and .ele files are numbered by frame \n",
         "and can be viewed by Jonathan R. Shewchuck's program showme\n",
         "(found here: https://www.cs.cmu.edu/~quake/showme.html)\n",
-        "WARNING, the -print option produces a .node and .ele file for EVERY frame AND disables parallelization!\n",
-        "(So don't be surprised when you come back hours later and see a hundred thousand new files in your current directory)\n\n",
+        "WARNING, the -print option produces a .node and .ele file for EVERY frame!\n",
+        "(So don't be surprised when you come back hours later and see a hundred thousand new files in your current directory)\n",
+        "To keep the triangulations of all frames in a single file instead, set -mesh (see the readme for its format).\n",
+        "Set -overt to save the area of every atom of every frame to a binary file, such as the area per lipid\n",
+        "of each lipid of a bilayer. Each triangle's area is split evenly between its atoms (see the readme for the format).\n\n",
         "If you build g_tessla with OPENMP, you can set the number of threads to use with -nthreads X,\n",
-        "where X is the number of threads to use. The default is to use the maximum number of cores available.\n"
+        "where X is the number of threads to use. The default is to use the maximum number of cores available.\n\n",
+        "For long trajectories, set -stream to read and triangulate the trajectory frame by frame\n",
+        "instead of loading all of it into memory. -nbuf X sets the number of frames that can be in flight at once.\n",
+        "With -dense, -stream loads each frame into the grid as it is read.\n\n",
+        "With -dense, set -window X to get the area of every window of X consecutive frames instead of one area\n",
+        "for the whole trajectory. The window slides one frame at a time, and the areas are saved to the -o file.\n\n",
+        "Set -incremental to repair the triangulation of the previous frame with edge flips instead of\n",
+        "triangulating every frame from scratch. This is faster for trajectories with closely spaced frames.\n",
+        "Frames whose points moved too much are still triangulated from scratch. Needs -corr.\n\n",
+        "Set -ng X to tessellate the first X groups of the index file separately in the same pass over the trajectory,\n",
+        "such as the two leaflets of a bilayer. The -o file then has the columns of every group, one group after the other.\n\n",
+        "Set -timing to log the wall-clock time spent in each stage of the Delaunay triangulation,\n",
+        "counts of the exact predicate fallbacks, allocated edges and removed duplicates, and the load balance of the threads.\n\n",
+        "-schedule sets how the frames are distributed over the threads: static (the default) gives each thread\n",
+        "a block of consecutive frames, which -incremental needs, while dynamic and guided hand out\n",
+        "-chunk frames at a time to whichever thread is free, which balances frames of different cost.\n\n",
+        "Set -follow to monitor a trajectory that is still being written, such as the -x output of a running mdrun.\n",
+        "Each frame is tessellated as soon as it is written, and its line is appended to the -o file right away.\n",
+        "g_tessla stops once no new frame has been written for -wait X seconds (by default it waits until interrupted).\n",
+        "-f can also be a named pipe that another program writes frames to, in which case g_tessla stops when the pipe is closed.\n",
+        "mdrun may only flush its output at checkpoints, so a short mdrun -cpt interval makes frames arrive sooner.\n\n",
+        "Set -stats to only keep summary statistics instead of the areas of every frame, which takes the same memory\n",
+        "for any number of frames (with -stream). The -o file then has the mean, standard deviation, range and standard error\n",
+        "of each area, the standard error from averages over blocks of 1, 2, 4, ... consecutive frames,\n",
+        "which accounts for correlated frames, and a histogram of the area per particle of -hbins bins from -hmin to -hmax.\n\n",
+        "If g_tessla was built with make PARALLEL=mpi and is started with mpirun, the MPI ranks split the frames\n",
+        "into blocks of consecutive frames, each rank tessellating its block with -nthreads threads,\n",
+        "and rank 0 saves the areas of all frames.\n",
+        "-dense, -follow, -stats, -print, -mesh and -overt are not split and run on rank 0 only.\n"
     };
 
     const char *fnames[efT_NUMFILES];
@@ -68,72 +131,227 @@ int main(int argc, char *argv[]) {
     gmx_bool print = FALSE;
     real cell_width = 0.1;
     gmx_bool linear = FALSE;
+    gmx_bool stream = FALSE;
+    int nbuf = 0;
+    gmx_bool incremental = FALSE;
+    int window = 0;
+    int skip = 1;
+    int ngroups = 1;
+    gmx_bool timing = FALSE;
+    const char *schedule[] = {NULL, "static", "dynamic", "guided", NULL};
+    int chunk = 0;
+    gmx_bool follow = FALSE;
+    real wait = 0;
+    gmx_bool stats = FALSE;
+    real hist_min = 0;
+    real hist_max = 2;
+    int hist_bins = 200;
+
+    int rank = 0, nranks = 1;
+#ifdef GTA_MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+#endif
 
-    init_log("gta.log", argc, argv);
+    if(rank == 0) // the other ranks only print to stdout
+        init_log("gta.log", argc, argv);
 
     t_filenm fnm[] = {
         {efTRX, "-f", "traj.xtc", ffREAD},
         {efNDX, "-n", "index.ndx", ffOPTRD},
-        {efDAT, "-o", "tessellated_areas.dat", ffWRITE}
+        {efDAT, "-o", "tessellated_areas.dat", ffWRITE},
+        {efDAT, "-obin", "tessellated_areas_bin.dat", ffOPTWR},
+        {efDAT, "-mesh", "triangles_mesh.dat", ffOPTWR},
+        {efDAT, "-overt", "vertex_areas.dat", ffOPTWR}
     };
 
     t_pargs pa[] = {
         {"-nthreads", FALSE, etINT, {&nthreads}, "set the number of parallel threads to use (default is max available)"}, 
+        {"-skip", FALSE, etINT, {&skip}, "only use every nr-th frame (after -b, -e and -dt)"},
+        {"-ng", FALSE, etINT, {&ngroups}, "number of index groups to tessellate separately (not with -dense)"},
         {"-dense", FALSE, etBOOL, {&dense}, "use weighted-grid tessellation instead of frame-by-frame delaunay triangulation"},
         {"-corr", FALSE, etBOOL, {&corr}, "correct triangulation area for periodic bounding"},
         {"-espace", FALSE, etREAL, {&espace}, "the spacing of the edge correction point intervals if using -corr (default = 0.8)"},
         {"-2d", FALSE, etBOOL, {&a2D}, "calculate 2D surface area from delaunay triangulation"},
         {"-print", FALSE, etBOOL, {&print}, "BE CAREFUL (see readme); save delaunay triangles to .node and .ele files"},
         {"-width", FALSE, etREAL, {&cell_width}, "width of each grid cell if using -dense"},
-        {"-lin", FALSE, etBOOL, {&linear}, "use distance instead of distance squared for weighing if using -dense"}
+        {"-lin", FALSE, etBOOL, {&linear}, "use distance instead of distance squared for weighing if using -dense"},
+        {"-window", FALSE, etINT, {&window}, "if using -dense, calculate the area of every window of this many consecutive frames"},
+        {"-stream", FALSE, etBOOL, {&stream}, "read and triangulate the trajectory frame by frame instead of loading it all into memory"},
+        {"-nbuf", FALSE, etINT, {&nbuf}, "number of frames in flight if using -stream (default is a few per thread)"},
+        {"-incremental", FALSE, etBOOL, {&incremental}, "repair the previous frame's triangulation instead of triangulating each frame from scratch"},
+        {"-timing", FALSE, etBOOL, {&timing}, "log the time spent in each stage and counters of the triangulation"},
+        {"-schedule", FALSE, etENUM, {schedule}, "distribution of the frames over the threads"},
+        {"-chunk", FALSE, etINT, {&chunk}, "number of frames handed to a thread at a time by -schedule (default depends on the schedule)"},
+        {"-follow", FALSE, etBOOL, {&follow}, "tessellate the frames of a trajectory that is still being written as they arrive"},
+        {"-wait", FALSE, etREAL, {&wait}, "with -follow, stop after this many seconds without a new frame (0 waits until interrupted)"},
+        {"-stats", FALSE, etBOOL, {&stats}, "only save summary statistics of the areas instead of the areas of every frame"},
+        {"-hmin", FALSE, etREAL, {&hist_min}, "lower bound of the area per particle histogram of -stats"},
+        {"-hmax", FALSE, etREAL, {&hist_max}, "upper bound of the area per particle histogram of -stats"},
+        {"-hbins", FALSE, etINT, {&hist_bins}, "number of bins of the area per particle histogram of -stats"}
     };
 
-    parse_common_args(&argc, argv, 0, efT_NUMFILES, fnm, asize(pa), pa, asize(desc), desc, 0, NULL, &oenv);
+    parse_common_args(&argc, argv, PCA_CAN_TIME, efT_NUMFILES, fnm, asize(pa), pa, asize(desc), desc, 0, NULL, &oenv);
 
     fnames[efT_TRAJ] = opt2fn("-f", efT_NUMFILES, fnm);
     fnames[efT_NDX] = opt2fn_null("-n", efT_NUMFILES, fnm);
     fnames[efT_OUTDAT] = opt2fn("-o", efT_NUMFILES, fnm);
+    fnames[efT_OUTBIN] = opt2fn_null("-obin", efT_NUMFILES, fnm);
+    fnames[efT_MESH] = opt2fn_null("-mesh", efT_NUMFILES, fnm);
+    fnames[efT_OUTVERT] = opt2fn_null("-overt", efT_NUMFILES, fnm);
+
+    // Only the per-frame areas of the Delaunay path are split between MPI ranks, anything else runs on rank 0
+    gmx_bool split = nranks > 1 && !dense && !follow && !stats && !print && !fnames[efT_MESH] && !fnames[efT_OUTVERT];
+    if(nranks > 1 && !split) {
+        if(rank > 0) {
+#ifdef GTA_MPI
+            MPI_Finalize();
+#endif
+            return 0;
+        }
+        print_log("-dense, -follow, -stats, -print, -mesh and -overt are not split between MPI ranks, running on rank 0 only.\n");
+    }
+    if(split)
+        set_traj_partition(rank, nranks);
+
+    if(timing)
+        gta_timing_init(nthreads);
 
     if(dense) {
         real (*fweight)(rvec, rvec) = linear ? weight_dist : weight_dist2;
-        struct tessellated_grid grid;
 
-        gta_grid_area(fnames[efT_TRAJ], fnames[efT_NDX], cell_width, fweight, &oenv, &grid);
+        if(ngroups > 1)
+            print_log("-ng is not supported with -dense, only using the first group.\n");
+        if(follow)
+            print_log("-follow is not supported with -dense, using the frames that have been written so far.\n");
+        if(stats)
+            print_log("-stats is not supported with -dense.\n");
+        if(fnames[efT_OUTVERT])
+            print_log("-overt is not supported with -dense.\n");
+
+#ifdef _OPENMP
+        if(nthreads > 0)
+            omp_set_num_threads(nthreads);
+#endif
+
+        if(window > 0) {
+            struct grid_window_area areas;
+
+            if(stream)
+                print_log("-stream is not supported with -window, reading the whole trajectory.\n");
 
-        if(grid.num_empty > 0) {
-            print_log("\n\nWARNING: %d grid cell(s) have empty corner(s).\n"
-                "If there are gaps in your system's area of the grid, increase grid spacing with the -width option.\n"
-                "The current width is %f.\n", grid.num_empty, grid.cell_width);
+            window_gta_grid_area(fnames[efT_TRAJ], fnames[efT_NDX], cell_width, fweight, window, &oenv, skip, &areas);
+
+            print_grid_window_area(fnames[efT_OUTDAT], &areas);
+
+            free_grid_window_area(&areas);
         }
+        else {
+            struct tessellated_grid grid;
+
+            if(stream)
+                stream_gta_grid_area(fnames[efT_TRAJ], fnames[efT_NDX], cell_width, fweight, &oenv, skip, &grid);
+            else
+                gta_grid_area(fnames[efT_TRAJ], fnames[efT_NDX], cell_width, fweight, &oenv, skip, &grid);
 
-        print_log("Tessellated surface area per particle: %f\n", grid.area_per_particle);
+            if(grid.num_empty > 0) {
+                print_log("\n\nWARNING: %d grid cell(s) have empty corner(s).\n"
+                    "If there are gaps in your system's area of the grid, increase grid spacing with the -width option.\n"
+                    "The current width is %f.\n", grid.num_empty, grid.cell_width);
+            }
 
-        print_grid(&grid, fnames[efT_OUTDAT]);
+            print_log("Tessellated surface area per particle: %f\n", grid.area_per_particle);
 
-        free_grid(&grid);
+            print_grid(&grid, fnames[efT_OUTDAT]);
+
+            free_grid(&grid);
+        }
     }
     else {
-        if(print)   nthreads = 1;
-
         struct tri_area areas;
+        struct gta_stats area_stats;
+
+        areas.stats = NULL;
+        if(stats && follow) {
+            print_log("-stats is not supported with -follow, saving the areas of every frame.\n");
+        }
+        else if(stats) {
+            gta_stats_init(&area_stats, hist_min, hist_max, hist_bins);
+            areas.stats = &area_stats;
+        }
 
-        unsigned long flags = ((int)corr * GTA_CORRECT) 
-                            | ((int)a2D * GTA_2D) 
-                            | ((int)print * GTA_PRINT);
+        if(incremental && !corr) {
+            print_log("-incremental needs -corr, since the convex hull changes from frame to frame without it. "
+                "Triangulating every frame from scratch.\n");
+            incremental = FALSE;
+        }
+
+        struct gta_options opt;
+        gta_options_init(&opt);
+        opt.flags = ((int)corr * GTA_CORRECT) 
+                  | ((int)a2D * GTA_2D) 
+                  | ((int)print * GTA_PRINT) 
+                  | ((int)incremental * GTA_INCREMENTAL);
+        opt.espace = espace;
+        opt.nthreads = nthreads;
+        opt.chunk = chunk;
+
+        if(schedule[0] && strcmp(schedule[0], "dynamic") == 0)
+            opt.schedule = GTA_SCHED_DYNAMIC;
+        else if(schedule[0] && strcmp(schedule[0], "guided") == 0)
+            opt.schedule = GTA_SCHED_GUIDED;
         
-        tessellate_area(fnames[efT_TRAJ], fnames[efT_NDX], &oenv, espace, nthreads, &areas, flags);
+        if(follow) {
+            follow_signals();
+            follow_tessellate_area(fnames[efT_TRAJ], fnames[efT_NDX], ngroups, &oenv, skip, &opt, wait, 
+                fnames[efT_OUTDAT], fnames[efT_MESH], fnames[efT_OUTVERT], &areas);
+        }
+        else if(stream)
+            stream_tessellate_area(fnames[efT_TRAJ], fnames[efT_NDX], ngroups, &oenv, skip, &opt, nbuf, 
+                fnames[efT_MESH], fnames[efT_OUTVERT], &areas);
+        else
+            tessellate_area(fnames[efT_TRAJ], fnames[efT_NDX], ngroups, &oenv, skip, &opt, 
+                fnames[efT_MESH], fnames[efT_OUTVERT], &areas);
 
-        print_areas(fnames[efT_OUTDAT], &areas);
+#ifdef GTA_MPI
+        if(split)
+            gather_tri_area(&areas);
+#endif
 
+        double start = gta_tic();
+        if(rank == 0) { // holds the areas of all ranks
+            if(areas.stats)
+                gta_stats_print(fnames[efT_OUTDAT], areas.stats);
+            else if(!follow) // already written frame by frame
+                print_areas(fnames[efT_OUTDAT], &areas);
+            if(fnames[efT_OUTBIN]) {
+                if(areas.stats)
+                    print_log("-obin is not supported with -stats.\n");
+                else
+                    print_areas_bin(fnames[efT_OUTBIN], &areas, opt.flags);
+            }
+        }
+        gta_toc(GTA_T_OUTPUT, start);
+
+        if(areas.stats)
+            gta_stats_free(areas.stats);
         free_tri_area(&areas);
     }
 
+    gta_timing_report();
+
 #ifdef GTA_BENCH
     clock_t clocks = clock() - start;
     print_log("g_tessla took %d clocks, %f seconds.\n", clocks, (float)clocks/CLOCKS_PER_SEC);
 #endif
 
-    close_log();
+    if(rank == 0)
+        close_log();
+#ifdef GTA_MPI
+    MPI_Finalize();
+#endif
 
     return 0;
 }
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ *
+ * This program uses the GROMACS molecular simulation package API.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team.
+ * Copyright (c) 2013,2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed at http://www.gromacs.org.
+ *
+ * Standalone benchmark of the triangulation and grid routines on synthetic membrane-like point sets.
+ * Build with make bench and run build/gta_bench [-n natoms]... [-f nframes] [-t maxthreads] [-grid maxatoms] [-seed X]
+ */
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "smalloc.h"
+
+#include "gkut_log.h"
+
+#include "delaunay_tri.h"
+#include "gta_grid.h"
+#include "gta_tri.h"
+
+#define MAXSIZES 16 // Maximum number of -n options
+#define SPACING 0.8 // Lattice spacing in nm, about the distance between the headgroups of neighboring lipids
+#define JITTER 0.25 // Maximum random displacement of a lattice point in units of SPACING
+#define UNDULATION 1.0 // Amplitude in nm of the undulating surface
+#define NWAVES 2 // Number of undulation periods along each side of the box
+#define DUPSTEP 10 // Every DUPSTEP-th point of a duplicates set is an exact copy of the point before it
+#define GRIDWIDTH 0.1 // Grid cell width of the grid benchmark, same as the -width default of g_tessla
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Synthetic point sets
+enum {
+    GEN_LATTICE, // jittered square lattice with a little noise in z
+    GEN_UNDULATE, // jittered lattice on the surface z = UNDULATION * sin(x) * cos(y)
+    GEN_DUPLICATE, // jittered lattice with exact duplicate points
+    GEN_COLLINEAR, // jittered lattice whose outer rows and columns lie exactly on the box edges
+    GEN_NUM
+};
+
+static const char *gen_names[GEN_NUM] = {"lattice", "undulating", "duplicates", "collinear"};
+
+
+static double wall_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static inline int max_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static inline void set_threads(int nthreads) {
+#ifdef _OPENMP
+    omp_set_num_threads(nthreads);
+#endif
+}
+
+// xorshift generator, so that the point sets are the same on every platform
+static inline double rand_unit(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double rand_jitter(unsigned long long *state) {
+    return (2 * rand_unit(state) - 1) * JITTER * SPACING;
+}
+
+
+static void gen_frame(int gen, int natoms, unsigned long long seed, rvec *x, matrix box);
+/* Generates one frame of natoms points of the given set into x and its box.
+ * The points lie on a side x side lattice with side = ceil(sqrt(natoms)), the last row only partially filled.
+ */
+
+static rvec **gen_traj(int gen, int nframes, int natoms, unsigned long long seed, matrix **box);
+/* Generates nframes frames of a point set with different random displacements.
+ * Memory is allocated for the frames and their boxes. Free them with free_traj.
+ */
+
+static void free_traj(rvec **x, matrix *box, int nframes);
+
+static void bench_dtriangulate(rvec **x, int nframes, int natoms);
+/* Times dtriangulate on every frame in a single thread.
+ */
+
+static void bench_surface_area(rvec **x, matrix *box, int nframes, int natoms, int maxthreads);
+/* Times delaunay_surface_area_ws on all frames in parallel for 1, 2, 4, ... maxthreads threads.
+ */
+
+static void bench_grid_area(rvec **x, int nframes, int natoms, int maxthreads);
+/* Times f_gta_grid_area on all frames for 1, 2, 4, ... maxthreads threads.
+ */
+
+
+int main(int argc, char *argv[]) {
+    int sizes[MAXSIZES] = {1000, 10000, 100000}, nsizes = 3;
+    int nframes = 32;
+    int maxthreads = max_threads();
+    int grid_max = 20000; // the grid takes a lot of memory for large systems, so only smaller ones are benchmarked
+    unsigned long long seed = 1;
+    int user_sizes = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        if(i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            if(!user_sizes)     nsizes = 0, user_sizes = 1;
+            if(nsizes < MAXSIZES)   sizes[nsizes++] = atoi(argv[++i]);
+            else                    ++i;
+        }
+        else if(i + 1 < argc && strcmp(argv[i], "-f") == 0)     nframes = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i], "-t") == 0)     maxthreads = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i], "-grid") == 0)  grid_max = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i], "-seed") == 0)  seed = strtoull(argv[++i], NULL, 10);
+        else {
+            fprintf(stderr, "Usage: %s [-n natoms]... [-f nframes] [-t maxthreads] [-grid maxatoms] [-seed X]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(nframes < 1)     nframes = 1;
+    if(maxthreads < 1)  maxthreads = 1;
+    if(seed == 0)       seed = 1; // xorshift gets stuck at 0
+
+    init_log("gta_bench.log", argc, argv);
+    print_log("Benchmarking %d frames per point set with up to %d threads.\n", nframes, maxthreads);
+
+    dtinit();
+
+    for(int s = 0; s < nsizes; ++s) {
+        int natoms = sizes[s];
+        if(natoms < 3)
+            continue;
+
+        for(int gen = 0; gen < GEN_NUM; ++gen) {
+            matrix *box;
+            rvec **x = gen_traj(gen, nframes, natoms, seed, &box);
+
+            print_log("\n%s, %d points:\n", gen_names[gen], natoms);
+            bench_dtriangulate(x, nframes, natoms);
+            bench_surface_area(x, box, nframes, natoms, maxthreads);
+            if(natoms <= grid_max)
+                bench_grid_area(x, nframes, natoms, maxthreads);
+
+            free_traj(x, box, nframes);
+        }
+    }
+
+    close_log();
+
+    return 0;
+}
+
+
+static void gen_frame(int gen, int natoms, unsigned long long seed, rvec *x, matrix box) {
+    int side = (int)ceil(sqrt((double)natoms));
+    real len = side * SPACING;
+    unsigned long long state = seed;
+
+    memset(box, 0, sizeof(matrix));
+    box[XX][XX] = box[YY][YY] = len;
+    box[ZZ][ZZ] = 4 * UNDULATION + 1;
+
+    for(int i = 0; i < natoms; ++i) {
+        int ix = i % side, iy = i / side;
+        real px = (ix + 0.5) * SPACING + rand_jitter(&state);
+        real py = (iy + 0.5) * SPACING + rand_jitter(&state);
+        real pz = 0.5 * box[ZZ][ZZ] + 0.1 * rand_jitter(&state);
+
+        switch(gen) {
+            case GEN_UNDULATE:
+                pz += UNDULATION * sin(2 * M_PI * NWAVES * px / len) * cos(2 * M_PI * NWAVES * py / len);
+                break;
+            case GEN_DUPLICATE:
+                if(i % DUPSTEP == DUPSTEP - 1) {
+                    copy_rvec(x[i-1], x[i]);
+                    continue;
+                }
+                break;
+            case GEN_COLLINEAR:
+                if(ix == 0)         px = 0;
+                if(ix == side - 1)  px = len;
+                if(iy == 0)         py = 0;
+                if(iy == side - 1)  py = len;
+                break;
+        }
+
+        x[i][XX] = px;
+        x[i][YY] = py;
+        x[i][ZZ] = pz;
+    }
+}
+
+static rvec **gen_traj(int gen, int nframes, int natoms, unsigned long long seed, matrix **box) {
+    rvec **x;
+
+    snew(x, nframes);
+    snew(*box, nframes);
+    for(int fr = 0; fr < nframes; ++fr) {
+        snew(x[fr], natoms);
+        gen_frame(gen, natoms, seed * 7919 + fr + 1, x[fr], (*box)[fr]);
+    }
+
+    return x;
+}
+
+static void free_traj(rvec **x, matrix *box, int nframes) {
+    for(int fr = 0; fr < nframes; ++fr) {
+        sfree(x[fr]);
+    }
+    sfree(x);
+    sfree(box);
+}
+
+
+static void bench_dtriangulate(rvec **x, int nframes, int natoms) {
+    struct dTriangulation tri;
+    double elapsed = 0;
+    long ntriangles = 0;
+
+    tri.npoints = natoms;
+    snew(tri.points, 2 * natoms);
+
+    for(int fr = 0; fr < nframes; ++fr) {
+        for(int i = 0; i < natoms; ++i) {
+            tri.points[2*i] = x[fr][i][XX];
+            tri.points[2*i + 1] = x[fr][i][YY];
+        }
+
+        double start = wall_time();
+        dtriangulate(&tri);
+        elapsed += wall_time() - start;
+
+        ntriangles += tri.ntriangles;
+        sfree(tri.triangles);
+    }
+
+    sfree(tri.points);
+
+    print_log("  dtriangulate:          %10.3f ms/frame %12.0f points/s  (%ld triangles/frame)\n",
+        1e3 * elapsed / nframes, (double)natoms * nframes / elapsed, ntriangles / nframes);
+
+    if(sizeof(real) != sizeof(float))
+        return;
+
+    // the same frames read in place from the rvecs
+    elapsed = 0;
+    tri.points = NULL;
+    tri.nfpoints = natoms;
+    tri.fpoints2 = NULL;
+    tri.fstride = DIM;
+
+    for(int fr = 0; fr < nframes; ++fr) {
+        tri.fpoints = (const float*)x[fr];
+
+        double start = wall_time();
+        dtriangulate(&tri);
+        elapsed += wall_time() - start;
+
+        sfree(tri.triangles);
+    }
+
+    print_log("  dtriangulate (rvec):   %10.3f ms/frame %12.0f points/s\n",
+        1e3 * elapsed / nframes, (double)natoms * nframes / elapsed);
+}
+
+static void bench_surface_area(rvec **x, matrix *box, int nframes, int natoms, int maxthreads) {
+    double base = 0;
+    real *area;
+    snew(area, nframes);
+
+    for(int nthreads = 1; ; nthreads = 2 * nthreads < maxthreads ? 2 * nthreads : maxthreads) {
+        set_threads(nthreads);
+
+        double start = wall_time();
+#pragma omp parallel shared(x,box,area)
+        {
+            struct dtWorkspace *ws = dtws_new();
+#pragma omp for schedule(static)
+            for(int fr = 0; fr < nframes; ++fr) {
+                delaunay_surface_area_ws(x[fr], box[fr], natoms, 0, fr, NULL, &area[fr], ws);
+            }
+            dtws_free(ws);
+        }
+        double elapsed = wall_time() - start;
+
+        if(nthreads == 1)
+            base = elapsed;
+        print_log("  surface area %3d thr:  %10.1f frames/s %12.0f points/s  speedup %5.2f\n",
+            nthreads, nframes / elapsed, (double)natoms * nframes / elapsed, base / elapsed);
+
+        if(nthreads == maxthreads)
+            break;
+    }
+
+    set_threads(maxthreads);
+    sfree(area);
+}
+
+static void bench_grid_area(rvec **x, int nframes, int natoms, int maxthreads) {
+    double base = 0;
+
+    for(int nthreads = 1; ; nthreads = 2 * nthreads < maxthreads ? 2 * nthreads : maxthreads) {
+        struct tessellated_grid grid;
+
+        set_threads(nthreads);
+
+        double start = wall_time();
+        f_gta_grid_area(x, nframes, natoms, GRIDWIDTH, weight_dist2, &grid);
+        double elapsed = wall_time() - start;
+
+        if(nthreads == 1)
+            base = elapsed;
+        print_log("  grid area %3d thr:     %10.1f frames/s %12.0f points/s  speedup %5.2f\n",
+            nthreads, nframes / elapsed, (double)natoms * nframes / elapsed, base / elapsed);
+
+        free_grid(&grid);
+
+        if(nthreads == maxthreads)
+            break;
+    }
+
+    set_threads(maxthreads);
+}
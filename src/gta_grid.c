@@ -12,54 +12,227 @@
 #include "gta_grid.h"
 
 #include <float.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "smalloc.h"
 #include "vec.h"
 
 #include "gkut_io.h"
 #include "gkut_log.h"
+#include "gtessla.h"
+
+#define LOADCHUNK (1 << 20) // Maximum number of atoms binned at a time by load_grid (at least one frame is binned)
+
+static inline real *load_point(struct tessellated_grid *grid, int x, int y, int z);
+/* Returns the weight of grid point [x][y][z] for writing, allocating its brick if needed.
+ * Not thread-safe for points in the same brick.
+ */
+
+static void read_grid_traj(const char *traj_fname, const char *ndx_fname, output_env_t *oenv, int skip, 
+    rvec ***x, int *nframes, int *natoms);
+/* Reads a trajectory file, filtered by the index file if ndx_fname is not null.
+ */
+
+static void free_grid_traj(rvec **x, int nframes);
 
-static real gta_diag, gta_diag2;
+static void grow_grid(struct tessellated_grid *grid, const int start[DIM], const int lo[DIM], const int hi[DIM], int new_start[DIM]);
+/* Grows the bricks of a grid whose first grid point has the index start[d] (a multiple of GRID_BRICK)
+ * on some common lattice of grid points so that they hold the points lo[d] through hi[d] of that lattice.
+ * The new index of the first grid point is stored in new_start, grid->dim* are set
+ * to the number of grid points in the bricks, and grid->min* are not changed.
+ */
+
+static inline int thread_num() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
 
 real weight_dist(rvec traj_point, rvec grid_point) {
-    return gta_diag - sqrt(distance2(traj_point, grid_point));
+    return -sqrt(distance2(traj_point, grid_point));
 }
 
 real weight_dist2(rvec traj_point, rvec grid_point) {
-    return gta_diag2 - distance2(traj_point, grid_point);
+    return -distance2(traj_point, grid_point);
 }
 
 
 void gta_grid_area(const char *traj_fname, const char *ndx_fname, 
-    real cell_width, real (*fweight)(rvec, rvec), output_env_t *oenv, struct tessellated_grid *grid) {
-    rvec **pre_x, **x;
-    matrix *box;
+    real cell_width, real (*fweight)(rvec, rvec), output_env_t *oenv, int skip, struct tessellated_grid *grid) {
+    rvec **x;
     int nframes, natoms;
 
-    read_traj(traj_fname, &pre_x, &box, &nframes, &natoms, oenv);
+    read_grid_traj(traj_fname, ndx_fname, oenv, skip, &x, &nframes, &natoms);
+
+    f_gta_grid_area(x, nframes, natoms, cell_width, fweight, grid);
+
+    free_grid_traj(x, nframes);
+}
+
+
+void window_gta_grid_area(const char *traj_fname, const char *ndx_fname, 
+    real cell_width, real (*fweight)(rvec, rvec), int window, output_env_t *oenv, int skip, struct grid_window_area *areas) {
+    rvec **x;
+    int nframes, natoms;
+
+    read_grid_traj(traj_fname, ndx_fname, oenv, skip, &x, &nframes, &natoms);
+
+    f_window_gta_grid_area(x, nframes, natoms, cell_width, fweight, window, areas);
+
+    free_grid_traj(x, nframes);
+}
+
+
+static void read_grid_traj(const char *traj_fname, const char *ndx_fname, output_env_t *oenv, int skip, 
+    rvec ***x, int *nframes, int *natoms) {
+    matrix *box;
+
+    read_traj_ndx(traj_fname, ndx_fname, 1, x, &box, nframes, natoms, NULL, oenv, skip);
     sfree(box);
+}
+
+static void free_grid_traj(rvec **x, int nframes) {
+    for(int i = 0; i < nframes; ++i) {
+        sfree(x[i]);
+    }
+    sfree(x);
+}
 
-    // Filter trajectory by index file if present
-    if(ndx_fname != NULL) {
-        ndx_filter_traj(ndx_fname, pre_x, &x, nframes, &natoms);
 
-        for(int i = 0; i < nframes; ++i) {
-            sfree(pre_x[i]);
+// The first frame puts grid point 0 of a common lattice at its minimum coordinates (the anchor).
+// Before each frame is loaded, the bricks are grown to hold the lattice points around that frame's extremes,
+// padded by one point on each side in case the floor below rounds differently from the one in load_slab.
+// grid->min* is always the position of the first grid point in the bricks while loading,
+// and ox, oy, oz crop the grid to the minimum and maximum coordinates of all frames at the end,
+// using the same formulas as construct_grid.
+void stream_gta_grid_area(const char *traj_fname, const char *ndx_fname, 
+    real cell_width, real (*fweight)(rvec, rvec), output_env_t *oenv, int skip, struct tessellated_grid *grid) {
+    struct traj_stream stream;
+    rvec *x;
+    matrix box;
+    rvec anchor = {0, 0, 0}, minc = {0, 0, 0}, maxc = {0, 0, 0}, fmin, fmax; // lattice anchor and extremes of all frames (set by the first frame), extremes of the current frame
+    int start[DIM] = {0, 0, 0}, lo[DIM], hi[DIM];
+    int nframes = 0;
+
+    open_traj_stream(traj_fname, ndx_fname, 1, oenv, skip, &stream);
+    snew(x, stream.natoms);
+
+    memset(grid, 0, sizeof(*grid));
+    grid->cell_width = cell_width;
+
+    while(read_traj_stream(&stream, x, box)) {
+        copy_rvec(x[0], fmin);
+        copy_rvec(x[0], fmax);
+        for(int a = 1; a < stream.natoms; ++a) {
+            for(int d = 0; d < DIM; ++d) {
+                if(x[a][d] < fmin[d]) fmin[d] = x[a][d];
+                if(x[a][d] > fmax[d]) fmax[d] = x[a][d];
+            }
+        }
+
+        if(nframes == 0) {
+            copy_rvec(fmin, anchor);
+            copy_rvec(fmin, minc);
+            copy_rvec(fmax, maxc);
+        }
+
+        for(int d = 0; d < DIM; ++d) {
+            if(fmin[d] < minc[d]) minc[d] = fmin[d];
+            if(fmax[d] > maxc[d]) maxc[d] = fmax[d];
+            lo[d] = (int)floor((fmin[d] - anchor[d])/cell_width) - 1;
+            hi[d] = (int)floor((fmax[d] - anchor[d])/cell_width) + 2;
         }
-        sfree(pre_x);
+
+        grow_grid(grid, start, lo, hi, start);
+        grid->minx = anchor[XX] + start[XX] * cell_width;
+        grid->miny = anchor[YY] + start[YY] * cell_width;
+        grid->minz = anchor[ZZ] + start[ZZ] * cell_width;
+
+        load_grid(&x, 1, stream.natoms, fweight, grid);
+        ++nframes;
     }
-    else {
-        x = pre_x;
+
+    close_traj_stream(&stream);
+    sfree(x);
+
+    if(nframes == 0) {
+        print_log("No frames read from %s\n", traj_fname);
+        return;
     }
 
-    f_gta_grid_area(x, nframes, natoms, cell_width, fweight, grid);
+    real minx = grid->minx, miny = grid->miny, minz = grid->minz;
+    grid->ox = (int)((minc[XX] - minx)/cell_width);
+    grid->oy = (int)((minc[YY] - miny)/cell_width);
+    grid->oz = (int)((minc[ZZ] - minz)/cell_width);
+    grid->dimx = (int)((maxc[XX] - minx)/cell_width) + 2 - grid->ox;
+    grid->dimy = (int)((maxc[YY] - miny)/cell_width) + 2 - grid->oy;
+    grid->dimz = (int)((maxc[ZZ] - minz)/cell_width) + 2 - grid->oz;
+    grid->minx = minx + grid->ox * cell_width;
+    grid->miny = miny + grid->oy * cell_width;
+    grid->minz = minz + grid->oz * cell_width;
+    snew(grid->heightmap, grid->dimx * grid->dimy);
+    snew(grid->areas, (grid->dimx-1) * (grid->dimy-1));
+#ifdef GTA_DEBUG
+    print_log("Streamed %d frames, maxx = %f, maxy = %f, maxz = %f\n", nframes, maxc[XX], maxc[YY], maxc[ZZ]);
+#endif
 
-    // free memory
-    for(int i = 0; i < nframes; ++i) {
-        sfree(x[i]);
+    gen_tessellate_grid(grid);
+
+    grid->area_per_particle = grid->surface_area / stream.natoms;
+}
+
+
+// Rounds i down to a multiple of GRID_BRICK
+static inline int floor_brick(int i) {
+    return i >= 0 ? i / GRID_BRICK * GRID_BRICK : -((-i + GRID_BRICK - 1) / GRID_BRICK) * GRID_BRICK;
+}
+
+static void grow_grid(struct tessellated_grid *grid, const int start[DIM], const int lo[DIM], const int hi[DIM], int new_start[DIM]) {
+    int bdim[DIM] = {grid->bdimx, grid->bdimy, grid->bdimz};
+    int nstart[DIM], nbdim[DIM];
+    gmx_bool grow = FALSE;
+
+    for(int d = 0; d < DIM; ++d) {
+        int end = start[d] + bdim[d] * GRID_BRICK; // one past the last grid point in the bricks
+        int nend = hi[d] + 1 > end ? hi[d] + 1 : end;
+        nstart[d] = lo[d] < start[d] ? floor_brick(lo[d]) : start[d];
+        nbdim[d] = (nend - nstart[d] + GRID_BRICK - 1) / GRID_BRICK;
+        grow |= nbdim[d] != bdim[d];
+    }
+
+    if(grow) {
+        // offsets in bricks of the old bricks in the new ones
+        int bx0 = (start[XX] - nstart[XX]) / GRID_BRICK,
+            by0 = (start[YY] - nstart[YY]) / GRID_BRICK,
+            bz0 = (start[ZZ] - nstart[ZZ]) / GRID_BRICK;
+        real **bricks;
+
+        snew(bricks, nbdim[XX] * nbdim[YY] * nbdim[ZZ]);
+        for(int bx = 0; bx < bdim[XX]; ++bx) {
+            for(int by = 0; by < bdim[YY]; ++by) {
+                memcpy(&bricks[((bx0 + bx) * nbdim[YY] + by0 + by) * nbdim[ZZ] + bz0], 
+                    &grid->bricks[(bx * bdim[YY] + by) * bdim[ZZ]], bdim[ZZ] * sizeof(real*));
+            }
+        }
+        sfree(grid->bricks);
+
+        grid->bricks = bricks;
+        grid->bdimx = nbdim[XX], grid->bdimy = nbdim[YY], grid->bdimz = nbdim[ZZ];
+    }
+
+    grid->dimx = grid->bdimx * GRID_BRICK;
+    grid->dimy = grid->bdimy * GRID_BRICK;
+    grid->dimz = grid->bdimz * GRID_BRICK;
+    for(int d = 0; d < DIM; ++d) {
+        new_start[d] = nstart[d];
     }
-    sfree(x);
 }
 
 
@@ -69,14 +242,69 @@ void f_gta_grid_area(rvec **x, int nframes, int natoms,
 
     load_grid(x, nframes, natoms, fweight, grid);
 
-    gen_heightmap(grid);
-
-    tessellate_grid(grid);
+    gen_tessellate_grid(grid);
 
     grid->area_per_particle = grid->surface_area / natoms;
 }
 
 
+void f_window_gta_grid_area(rvec **x, int nframes, int natoms, 
+    real cell_width, real (*fweight)(rvec, rvec), int window, struct grid_window_area *areas) {
+    struct tessellated_grid grid;
+
+    if(window > nframes)
+        window = nframes;
+
+    areas->nwindows = nframes - window + 1;
+    areas->window = window;
+    areas->natoms = natoms;
+    snew(areas->area, areas->nwindows);
+    snew(areas->num_empty, areas->nwindows);
+
+    construct_grid(x, nframes, natoms, cell_width, &grid);
+    track_grid_changes(&grid);
+
+    load_grid(x, window, natoms, fweight, &grid);
+    gen_tessellate_grid(&grid);
+    areas->area[0] = grid.surface_area;
+    areas->num_empty[0] = grid.num_empty;
+
+    for(int i = 1; i < areas->nwindows; ++i) {
+        unload_grid(x + i - 1, 1, natoms, fweight, &grid);
+        load_grid(x + i + window - 1, 1, natoms, fweight, &grid);
+        update_grid_area(&grid);
+        areas->area[i] = grid.surface_area;
+        areas->num_empty[i] = grid.num_empty;
+    }
+
+    free_grid(&grid);
+}
+
+
+void print_grid_window_area(const char *fname, const struct grid_window_area *areas) {
+    FILE *f = fopen(fname, "w");
+    real sum = 0;
+
+    fprintf(f, "# Windows of %d frames\n", areas->window);
+    fprintf(f, "# FIRST-FRAME\tAREA\t\"\"/PARTICLE\tEMPTY-CELLS\n");
+    for(int i = 0; i < areas->nwindows; ++i) {
+        fprintf(f, "%d\t%f\t%f\t%d\n", i, areas->area[i], areas->area[i] / areas->natoms, areas->num_empty[i]);
+        sum += areas->area[i];
+    }
+    print_log("Average surface area: %f\n", sum / areas->nwindows);
+    print_log("Average area per particle: %f\n", (sum / areas->nwindows) / areas->natoms);
+
+    fclose(f);
+    print_log("Surface areas saved to %s\n", fname);
+}
+
+
+void free_grid_window_area(struct grid_window_area *areas) {
+    sfree(areas->area);
+    sfree(areas->num_empty);
+}
+
+
 void construct_grid(rvec **x, int nframes, int natoms, real cell_width, struct tessellated_grid *grid) {
     real minx = FLT_MAX, miny = FLT_MAX, minz = FLT_MAX, 
         maxx = FLT_MIN, maxy = FLT_MIN, maxz = FLT_MIN;
@@ -100,7 +328,12 @@ void construct_grid(rvec **x, int nframes, int natoms, real cell_width, struct t
     dimy = ((int)((maxy - miny)/cell_width) + 2);
     dimz = ((int)((maxz - minz)/cell_width) + 2);
 
-    snew(grid->weights, dimx * dimy * dimz);
+    grid->bdimx = (dimx + GRID_BRICK - 1) / GRID_BRICK;
+    grid->bdimy = (dimy + GRID_BRICK - 1) / GRID_BRICK;
+    grid->bdimz = (dimz + GRID_BRICK - 1) / GRID_BRICK;
+    snew(grid->bricks, grid->bdimx * grid->bdimy * grid->bdimz); // bricks are allocated by load_grid
+    grid->ox = grid->oy = grid->oz = 0;
+    grid->nloads = NULL, grid->dirty = NULL;
     snew(grid->heightmap, dimx * dimy);
     snew(grid->areas, (dimx-1) * (dimy-1));
     grid->dimx = dimx, grid->dimy = dimy, grid->dimz = dimz;
@@ -112,141 +345,410 @@ void construct_grid(rvec **x, int nframes, int natoms, real cell_width, struct t
 }
 
 
-void load_grid(rvec **x, int nframes, int natoms, real (*fweight)(rvec, rvec), struct tessellated_grid *grid) {
-    real *weights = grid->weights;
-    int dimx = grid->dimx, dimy = grid->dimy, dimz = grid->dimz;
-    int dimyz = dimy * dimz;
+void track_grid_changes(struct tessellated_grid *grid) {
+    snew(grid->nloads, grid->bdimx * grid->bdimy * grid->bdimz); // allocated along with the bricks of weights
+    snew(grid->dirty, grid->dimx * grid->dimy);
+}
+
+
+static inline real *load_point(struct tessellated_grid *grid, int x, int y, int z) {
+    int b = ((x / GRID_BRICK) * grid->bdimy + y / GRID_BRICK) * grid->bdimz + z / GRID_BRICK;
+    real **brick = &(grid->bricks[b]);
+    if(*brick == NULL) {
+        snew(*brick, GRID_BRICK * GRID_BRICK * GRID_BRICK);
+        if(grid->nloads)
+            snew(grid->nloads[b], GRID_BRICK * GRID_BRICK * GRID_BRICK);
+    }
+    return &((*brick)[((x % GRID_BRICK) * GRID_BRICK + y % GRID_BRICK) * GRID_BRICK + z % GRID_BRICK]);
+}
+
+// Adds (sign = 1) or takes out (sign = -1) the weight w of one atom to grid point [x][y][z].
+// Tracked grids count the atoms loaded into each weight, so that a weight that loses its last atom 
+// is reset to exactly 0 instead of a rounding error that could still count as a height in gen_heightmap.
+static inline void add_weight(struct tessellated_grid *grid, int x, int y, int z, real w, int sign) {
+    real *weight = load_point(grid, x, y, z);
+
+    if(grid->nloads == NULL) {
+        *weight += w;
+        return;
+    }
+
+    int *nload = &(grid->nloads[((x / GRID_BRICK) * grid->bdimy + y / GRID_BRICK) * grid->bdimz + z / GRID_BRICK]
+        [((x % GRID_BRICK) * GRID_BRICK + y % GRID_BRICK) * GRID_BRICK + z % GRID_BRICK]);
+    grid->dirty[x * grid->dimy + y] = 1;
+    if(sign > 0) {
+        *weight += w;
+        ++(*nload);
+    }
+    else if(--(*nload) == 0) {
+        *weight = 0;
+    }
+    else {
+        *weight -= w;
+    }
+}
+
+
+// Weight function of eval_weight
+enum {
+    WEIGHT_DIST, // weight_dist
+    WEIGHT_DIST2, // weight_dist2
+    WEIGHT_FUNC // any other function, called through the pointer
+};
+
+// diag and diag2 are the diagonal of a grid cell and its square, 
+// which weight_dist and weight_dist2 are offset by so that their weights are positive
+static inline real eval_weight(int wtype, real (*fweight)(rvec, rvec), real diag, real diag2, 
+    rvec traj_point, rvec grid_point) {
+    switch(wtype) {
+        case WEIGHT_DIST:   return diag - sqrt(distance2(traj_point, grid_point));
+        case WEIGHT_DIST2:  return diag2 - distance2(traj_point, grid_point);
+        default:            return fweight(traj_point, grid_point);
+    }
+}
+
+// Loads (sign = 1) or unloads (sign = -1) the eight grid points around each of the given atoms,
+// which must all be in the same slab of GRID_BRICK grid cells along x (see load_frames).
+// wtype and sign are constants at every call site, so each call gets its own inlined weight function.
+static inline void load_slab(struct tessellated_grid *grid, rvec **x, int natoms, int fr0,
+    const int *atoms, int nload, real diag, real diag2, int wtype, int sign, real (*fweight)(rvec, rvec)) {
     real cell_width = grid->cell_width;
     real minx = grid->minx, miny = grid->miny, minz = grid->minz;
 
-    gta_diag2 = 3 * cell_width * cell_width;
-    gta_diag = sqrt(gta_diag2);
-
     rvec grid_point;
     int xi, yi, zi;
 
-    for(int fr = 0; fr < nframes; ++fr) {
-        for(int a = 0; a < natoms; ++a) {
-            // Indices of the origin point of the grid cell surrounding this atom
-            xi = (int)((x[fr][a][XX] - minx)/cell_width);
-            yi = (int)((x[fr][a][YY] - miny)/cell_width);
-            zi = (int)((x[fr][a][ZZ] - minz)/cell_width);
-
-            // Load the eight grid points around this atom. Closer distance to atom = higher weight
-            grid_point[XX] = minx + xi * cell_width;
-            grid_point[YY] = miny + yi * cell_width; 
-            grid_point[ZZ] = minz + zi * cell_width;
-            // This order of operations is an attempt to minimize cache misses
-            weights[xi*dimyz + yi*dimz + zi]            += fweight(x[fr][a], grid_point);
-            grid_point[ZZ] += cell_width;
-            weights[xi*dimyz + yi*dimz + zi+1]          += fweight(x[fr][a], grid_point);
-            grid_point[YY] += cell_width;
-            grid_point[ZZ] -= cell_width;
-            weights[xi*dimyz + (yi+1)*dimz + zi]        += fweight(x[fr][a], grid_point);
-            grid_point[ZZ] += cell_width;
-            weights[xi*dimyz + (yi+1)*dimz + zi+1]      += fweight(x[fr][a], grid_point);
-            grid_point[XX] += cell_width;
-            grid_point[YY] -= cell_width;
-            grid_point[ZZ] -= cell_width;
-            weights[(xi+1)*dimyz + yi*dimz + zi]        += fweight(x[fr][a], grid_point);
-            grid_point[ZZ] += cell_width;
-            weights[(xi+1)*dimyz + yi*dimz + zi+1]      += fweight(x[fr][a], grid_point);
-            grid_point[YY] += cell_width;
-            grid_point[ZZ] -= cell_width;
-            weights[(xi+1)*dimyz + (yi+1)*dimz + zi]    += fweight(x[fr][a], grid_point);
-            grid_point[ZZ] += cell_width;
-            weights[(xi+1)*dimyz + (yi+1)*dimz + zi+1]  += fweight(x[fr][a], grid_point);
+    for(int i = 0; i < nload; ++i) {
+        real *xa = x[fr0 + atoms[i] / natoms][atoms[i] % natoms];
+
+        // Indices of the origin point of the grid cell surrounding this atom
+        xi = (int)((xa[XX] - minx)/cell_width);
+        yi = (int)((xa[YY] - miny)/cell_width);
+        zi = (int)((xa[ZZ] - minz)/cell_width);
+
+        // Load the eight grid points around this atom. Closer distance to atom = higher weight
+        grid_point[XX] = minx + xi * cell_width;
+        grid_point[YY] = miny + yi * cell_width;
+        grid_point[ZZ] = minz + zi * cell_width;
+        // This order of operations is an attempt to minimize cache misses
+        add_weight(grid, xi, yi, zi, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+        grid_point[ZZ] += cell_width;
+        add_weight(grid, xi, yi, zi+1, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+        grid_point[YY] += cell_width;
+        grid_point[ZZ] -= cell_width;
+        add_weight(grid, xi, yi+1, zi, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+        grid_point[ZZ] += cell_width;
+        add_weight(grid, xi, yi+1, zi+1, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+        grid_point[XX] += cell_width;
+        grid_point[YY] -= cell_width;
+        grid_point[ZZ] -= cell_width;
+        add_weight(grid, xi+1, yi, zi, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+        grid_point[ZZ] += cell_width;
+        add_weight(grid, xi+1, yi, zi+1, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+        grid_point[YY] += cell_width;
+        grid_point[ZZ] -= cell_width;
+        add_weight(grid, xi+1, yi+1, zi, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+        grid_point[ZZ] += cell_width;
+        add_weight(grid, xi+1, yi+1, zi+1, eval_weight(wtype, fweight, diag, diag2, xa, grid_point), sign);
+    }
+}
+
+// The atoms are binned by slabs of GRID_BRICK grid cells along x with a parallel counting sort,
+// LOADCHUNK atoms at a time. The atoms of slab s only touch the bricks with x-index s and s + 1
+// (the latter only at its first x-plane), so all even slabs can be loaded in parallel
+// without any atomics, including the allocation of new bricks, and then all odd slabs.
+// The columns written by a slab are likewise only shared with its neighbours, so marking them dirty is safe too.
+static void load_frames(rvec **x, int nframes, int natoms, real (*fweight)(rvec, rvec), int sign, 
+    struct tessellated_grid *grid) {
+    int nslabs = (grid->dimx - 1 + GRID_BRICK - 1) / GRID_BRICK;
+    real cell_width = grid->cell_width;
+    real minx = grid->minx;
+
+    // kept local rather than in statics, so that grids of different cell widths can be loaded concurrently
+    real diag2 = 3 * cell_width * cell_width;
+    real diag = sqrt(diag2);
+
+    int wtype = WEIGHT_FUNC;
+    if(fweight == weight_dist)          wtype = WEIGHT_DIST;
+    else if(fweight == weight_dist2)    wtype = WEIGHT_DIST2;
+
+    int chunk_frames = natoms > 0 && LOADCHUNK / natoms > 1 ? LOADCHUNK / natoms : 1;
+#ifdef _OPENMP
+    int maxthreads = omp_get_max_threads();
+#else
+    int maxthreads = 1;
+#endif
+
+    int *atoms; // indexes (frame * natoms + atom, relative to the chunk) of the atoms of the chunk sorted by slab
+    int *counts; // [nslabs][maxthreads] number of atoms per slab found by each thread, then their offsets in atoms
+    int *slab_start; // [nslabs + 1] offset of each slab in atoms
+    snew(atoms, chunk_frames * natoms);
+    snew(counts, nslabs * maxthreads);
+    snew(slab_start, nslabs + 1);
+
+    for(int fr0 = 0; fr0 < nframes; fr0 += chunk_frames) {
+        int nchunk = (nframes - fr0 < chunk_frames ? nframes - fr0 : chunk_frames) * natoms;
+
+#pragma omp parallel shared(x,atoms,counts,slab_start)
+        {
+            int t = thread_num();
+
+#pragma omp single
+            memset(counts, 0, nslabs * maxthreads * sizeof(int));
+
+            // count the atoms in each slab.
+            // This loop and the one below have the same static schedule, so each thread sees the same atoms in both
+#pragma omp for schedule(static)
+            for(int i = 0; i < nchunk; ++i) {
+                int s = (int)((x[fr0 + i / natoms][i % natoms][XX] - minx)/cell_width) / GRID_BRICK;
+                ++counts[s * maxthreads + t];
+            }
+
+#pragma omp single
+            {
+                int sum = 0;
+                for(int s = 0; s < nslabs; ++s) {
+                    slab_start[s] = sum;
+                    for(int th = 0; th < maxthreads; ++th) {
+                        int c = counts[s * maxthreads + th];
+                        counts[s * maxthreads + th] = sum;
+                        sum += c;
+                    }
+                }
+                slab_start[nslabs] = sum;
+            }
+
+#pragma omp for schedule(static)
+            for(int i = 0; i < nchunk; ++i) {
+                int s = (int)((x[fr0 + i / natoms][i % natoms][XX] - minx)/cell_width) / GRID_BRICK;
+                atoms[counts[s * maxthreads + t]++] = i;
+            }
+
+            // load the even slabs, then the odd slabs
+            for(int parity = 0; parity < 2; ++parity) {
+#pragma omp for schedule(dynamic)
+                for(int s = parity; s < nslabs; s += 2) {
+                    const int *slab = atoms + slab_start[s];
+                    int nload = slab_start[s + 1] - slab_start[s];
+                    if(sign < 0)
+                        load_slab(grid, x, natoms, fr0, slab, nload, diag, diag2, wtype, -1, fweight);
+                    else if(wtype == WEIGHT_DIST)
+                        load_slab(grid, x, natoms, fr0, slab, nload, diag, diag2, WEIGHT_DIST, 1, fweight);
+                    else if(wtype == WEIGHT_DIST2)
+                        load_slab(grid, x, natoms, fr0, slab, nload, diag, diag2, WEIGHT_DIST2, 1, fweight);
+                    else
+                        load_slab(grid, x, natoms, fr0, slab, nload, diag, diag2, WEIGHT_FUNC, 1, fweight);
+                }
+            }
         }
     }
+
+    sfree(atoms);
+    sfree(counts);
+    sfree(slab_start);
 }
 
+void load_grid(rvec **x, int nframes, int natoms, real (*fweight)(rvec, rvec), struct tessellated_grid *grid) {
+    load_frames(x, nframes, natoms, fweight, 1, grid);
+}
 
-void gen_heightmap(struct tessellated_grid *grid) {
-    real *weights = grid->weights;
-    int dimx = grid->dimx, dimy = grid->dimy, dimz = grid->dimz;
-    int dimyz = dimy * dimz;
+void unload_grid(rvec **x, int nframes, int natoms, real (*fweight)(rvec, rvec), struct tessellated_grid *grid) {
+    load_frames(x, nframes, natoms, fweight, -1, grid);
+}
 
-    int *heightmap = grid->heightmap;
 
-    int maxz;
-    real max_weight;
+// Returns the z-index of the grid point with the maximum weight in the x-y column [x][y],
+// or -1 if none of its weights is > ~0.
+static inline int column_height(const struct tessellated_grid *grid, int x, int y) {
+    int dimz = grid->dimz, bdimy = grid->bdimy, bdimz = grid->bdimz;
+    int ox = grid->ox, oy = grid->oy, oz = grid->oz;
+
+    int maxz = -1;
+    real max_weight = 2 * FLT_EPSILON; // To protect the criterion above in case of floating point imprecision
+
+    // z runs over the grid points oz to oz + dimz - 1 of the bricks
+    int bx = x + ox, by = y + oy;
+    real **bricks = grid->bricks + ((bx / GRID_BRICK) * bdimy + by / GRID_BRICK) * bdimz;
+    int offset = ((bx % GRID_BRICK) * GRID_BRICK + by % GRID_BRICK) * GRID_BRICK;
+    for(int bz = oz / GRID_BRICK; bz * GRID_BRICK < oz + dimz; ++bz) {
+        if(bricks[bz] == NULL) // never loaded, all weights are 0
+            continue;
+        const real *w = bricks[bz] + offset;
+        int z0 = bz * GRID_BRICK < oz ? oz - bz * GRID_BRICK : 0;
+        int nz = oz + dimz - bz * GRID_BRICK < GRID_BRICK ? oz + dimz - bz * GRID_BRICK : GRID_BRICK;
+        for(int z = z0; z < nz; ++z) {
+            if(w[z] > max_weight) {
+                max_weight = w[z];
+                maxz = bz * GRID_BRICK + z - oz;
+            }
+        }
+    }
+
+    return maxz;
+}
+
+void gen_heightmap(struct tessellated_grid *grid) {
+    int dimx = grid->dimx, dimy = grid->dimy;
+    int *heightmap = grid->heightmap;
     int num_empty = 0;
 
     for(int x = 0; x < dimx; ++x) {
         for(int y = 0; y < dimy; ++y) {
-            maxz = -1; // If none of the weights in this column is > ~0, then this column's z index will be -1 
-            max_weight = 2 * FLT_EPSILON; // To protect the criterion above in case of floating point imprecision
-            for(int z = 0; z < dimz; ++z) {
-                if(weights[x*dimyz + y*dimz + z] > max_weight) {
-                    max_weight = weights[x*dimyz + y*dimz + z];
-                    maxz = z;
-                }
-            }
+            int maxz = column_height(grid, x, y);
             heightmap[x*dimy + y] = maxz;
             num_empty += maxz < 0;
         }
     }
 
     grid->num_empty = num_empty;
+    if(grid->dirty)
+        memset(grid->dirty, 0, dimx * dimy);
 }
 
 
-void tessellate_grid(struct tessellated_grid *grid) {
-    int dimx = grid->dimx, dimy = grid->dimy, dimz = grid->dimz;
-    int *heightmap = grid->heightmap;
-    real *areas = grid->areas;
-    real cell_width = grid->cell_width;
+// Returns the area of the two triangles (a, b, d) and (a, d, c) of a grid cell of the given width
+// with corners a = [0][0], b = [0][1], c = [1][0] and d = [1][1] at the given z-indices.
+// With the heights relative to corner a, dz1, dz2, dz3 for b, c and d, 
+// the cross products of the edges are (w*(dz3-dz1), w*dz1, -w^2) and (w*dz2, w*(dz3-dz2), -w^2),
+// so this is branch-free and vectorizes along a row of cells.
+static inline real cell_tri_area(real cell_width, int ha, int hb, int hc, int hd) {
+    real w = cell_width;
+    real dz1 = (hb - ha) * w, dz2 = (hc - ha) * w, dz3 = (hd - ha) * w;
+
+    return 0.5 * w * (sqrt((dz3 - dz1) * (dz3 - dz1) + dz1 * dz1 + w * w) 
+                    + sqrt(dz2 * dz2 + (dz3 - dz2) * (dz3 - dz2) + w * w));
+}
+
+// Computes the areas of the row of grid cells between the heightmap rows h0 (x) and h1 (x + 1).
+// Cells with an empty corner get an area of 0. Returns the sum of the areas.
+static inline double row_areas(const int *h0, const int *h1, int dimy, real cell_width, real *areas) {
+    double tot_area = 0;
+
+    for(int y = 0; y < dimy - 1; ++y) {
+        int empty = (h0[y] | h0[y+1] | h1[y] | h1[y+1]) < 0;
+        real area = cell_tri_area(cell_width, h0[y], h0[y+1], h1[y], h1[y+1]);
+        areas[y] = empty ? 0 : area;
+        tot_area += areas[y];
+    }
+
+    return tot_area;
+}
+
+// Returns the triangulated area of the grid cell with origin [x][y] of the heightmap,
+// or 0 if any of its corners is empty.
+static inline real cell_area(const struct tessellated_grid *grid, int x, int y) {
+    int dimy = grid->dimy;
+    const int *heightmap = grid->heightmap;
 
-    real tot_area = 0, cell_area = 0;
+    int h0 = heightmap[x*dimy + y], h1 = heightmap[x*dimy + y+1], 
+        h2 = heightmap[(x+1)*dimy + y], h3 = heightmap[(x+1)*dimy + y+1];
 
-    int i_heights[4];
-    rvec corners[] = {
-        {0.0, 0.0, 0.0}, 
-        {0.0, cell_width, 0.0}, 
-        {cell_width, 0.0, 0.0}, 
-        {cell_width, cell_width, 0.0}
-    };
-    rvec ab, ac, ad, cpr;
+    if((h0 | h1 | h2 | h3) < 0)
+        return 0.0;
 
 #ifdef GTA_DEBUG
-            print_log("Corner height indices:\n");
+    print_log("Cell [%d][%d]: %d %d %d %d\n", x, y, h0, h1, h2, h3);
 #endif
+    return cell_tri_area(grid->cell_width, h0, h1, h2, h3);
+}
+
+void tessellate_grid(struct tessellated_grid *grid) {
+    int dimx = grid->dimx, dimy = grid->dimy;
+    const int *heightmap = grid->heightmap;
+
+    double tot_area = 0;
 
     for(int x = 0; x < dimx - 1; ++x) {
-        for(int y = 0; y < dimy - 1; ++y) {
-            if(((i_heights[0] = heightmap[x*dimy + y]) < 0) 
-                || ((i_heights[1] = heightmap[x*dimy + y+1]) < 0) 
-                || ((i_heights[2] = heightmap[(x+1)*dimy + y]) < 0) 
-                || ((i_heights[3] = heightmap[(x+1)*dimy + y+1]) < 0)) {
-                areas[x*dimy + y] = 0.0;
-                continue;
-            }
+        tot_area += row_areas(heightmap + x*dimy, heightmap + (x+1)*dimy, dimy, grid->cell_width, 
+            grid->areas + x*(dimy-1));
+    }
 
-#ifdef GTA_DEBUG
-            print_log("Cell [%d][%d]: %d %d %d %d\n", 
-                x, y, i_heights[0], i_heights[1], i_heights[2], i_heights[3]);
+    grid->surface_area = tot_area;
+}
+
+
+// The x-rows are split into one contiguous block per thread. Each thread computes the heights of a row 
+// and then the cells between it and the row before, so both rows are still in cache.
+// The cells between the last row of a block and the first row of the next need the heights of the latter,
+// which the thread computes again into its own buffer rather than waiting for the next thread.
+void gen_tessellate_grid(struct tessellated_grid *grid) {
+    int dimx = grid->dimx, dimy = grid->dimy;
+    int *heightmap = grid->heightmap;
+    real *areas = grid->areas;
+    real cell_width = grid->cell_width;
+
+    double tot_area = 0;
+    int num_empty = 0;
+
+#pragma omp parallel reduction(+:tot_area,num_empty)
+    {
+#ifdef _OPENMP
+        int nthreads = omp_get_num_threads();
+#else
+        int nthreads = 1;
 #endif
-            corners[0][ZZ] = i_heights[0] * cell_width;
-            corners[1][ZZ] = i_heights[1] * cell_width;
-            corners[2][ZZ] = i_heights[2] * cell_width;
-            corners[3][ZZ] = i_heights[3] * cell_width;
+        int t = thread_num();
+        int x0 = (int)((long)dimx * t / nthreads), x1 = (int)((long)dimx * (t + 1) / nthreads);
+
+        for(int x = x0; x < x1; ++x) {
+            int *h = heightmap + x*dimy;
+            for(int y = 0; y < dimy; ++y) {
+                h[y] = column_height(grid, x, y);
+                num_empty += h[y] < 0;
+            }
+            if(x > x0)
+                tot_area += row_areas(h - dimy, h, dimy, cell_width, areas + (x-1)*(dimy-1));
+        }
 
-            rvec_sub(corners[1], corners[0], ab);
-            rvec_sub(corners[2], corners[0], ac);
-            rvec_sub(corners[3], corners[0], ad);
+        if(x1 > x0 && x1 < dimx) {
+            int *next;
+            snew(next, dimy);
+            for(int y = 0; y < dimy; ++y) {
+                next[y] = column_height(grid, x1, y);
+            }
+            tot_area += row_areas(heightmap + (x1-1)*dimy, next, dimy, cell_width, areas + (x1-1)*(dimy-1));
+            sfree(next);
+        }
+    }
 
-            cprod(ab, ad, cpr);
-            cell_area = norm(cpr) / 2.0;
+    grid->num_empty = num_empty;
+    grid->surface_area = tot_area;
+    if(grid->dirty)
+        memset(grid->dirty, 0, dimx * dimy);
+}
 
-            cprod(ad, ac, cpr);
-            cell_area += norm(cpr) / 2.0;
 
-            tot_area += cell_area;
+// The dirty columns whose height did not change are cleared in the first pass, 
+// so the second pass only retriangulates the cells with a corner that moved.
+// The total is summed again from the cell areas instead of being updated by differences,
+// which would drift over a long trajectory.
+void update_grid_area(struct tessellated_grid *grid) {
+    int dimx = grid->dimx, dimy = grid->dimy;
+    int *heightmap = grid->heightmap;
+    real *areas = grid->areas;
+    char *dirty = grid->dirty;
 
-            areas[x*(dimy-1) + y] = cell_area;
+    for(int x = 0; x < dimx; ++x) {
+        for(int y = 0; y < dimy; ++y) {
+            if(!dirty[x*dimy + y])
+                continue;
+            int maxz = column_height(grid, x, y);
+            grid->num_empty += (maxz < 0) - (heightmap[x*dimy + y] < 0);
+            dirty[x*dimy + y] = maxz != heightmap[x*dimy + y];
+            heightmap[x*dimy + y] = maxz;
         }
     }
 
+    double tot_area = 0;
+    for(int x = 0; x < dimx - 1; ++x) {
+        for(int y = 0; y < dimy - 1; ++y) {
+            if(dirty[x*dimy + y] || dirty[x*dimy + y+1] || dirty[(x+1)*dimy + y] || dirty[(x+1)*dimy + y+1])
+                areas[x*(dimy-1) + y] = cell_area(grid, x, y);
+            tot_area += areas[x*(dimy-1) + y];
+        }
+    }
+
+    memset(dirty, 0, dimx * dimy);
     grid->surface_area = tot_area;
 }
 
@@ -265,7 +767,7 @@ void print_grid(struct tessellated_grid *grid, const char *fname) {
         for(int y = 0; y < dimy; ++y) {
             fprintf(f, "\n[%d][%d]: ", x, y);
             for(int z = 0; z < dimz; ++z) {
-                fprintf(f, "%f ", grid->weights[x*dimy*dimz + y*dimz + z]);
+                fprintf(f, "%f ", grid_weight(grid, x, y, z));
             }
         }
     }
@@ -314,7 +816,67 @@ void print_grid(struct tessellated_grid *grid, const char *fname) {
 
 
 void free_grid(struct tessellated_grid *grid) {
-    sfree(grid->weights);
+    for(int i = 0; i < grid->bdimx * grid->bdimy * grid->bdimz; ++i) {
+        sfree(grid->bricks[i]);
+    }
+    sfree(grid->bricks);
+    if(grid->nloads) {
+        for(int i = 0; i < grid->bdimx * grid->bdimy * grid->bdimz; ++i) {
+            sfree(grid->nloads[i]);
+        }
+        sfree(grid->nloads);
+    }
+    sfree(grid->dirty);
     sfree(grid->heightmap);
     sfree(grid->areas);
 }
+
+
+int gta_grid_frames_area(const struct gta_options *opt, 
+                         const float *xyz, 
+                         size_t nframes, 
+                         size_t natoms, 
+                         size_t stride, 
+                         size_t frame_stride, 
+                         double cell_width, 
+                         int linear, 
+                         double *area, 
+                         int *num_empty) {
+    if(natoms < 1 || nframes < 1 || natoms > INT_MAX / 8 || nframes > INT_MAX || stride < DIM || cell_width <= 0)
+        return -1;
+
+    rvec **x;
+    snew(x, nframes);
+    for(size_t fr = 0; fr < nframes; ++fr) {
+        snew(x[fr], natoms);
+        for(size_t i = 0; i < natoms; ++i) {
+            const float *xi = xyz + fr * frame_stride + i * stride;
+            x[fr][i][XX] = xi[XX];
+            x[fr][i][YY] = xi[YY];
+            x[fr][i][ZZ] = xi[ZZ];
+        }
+    }
+
+#ifdef _OPENMP
+    // the grid functions run with the number of threads of the calling thread, which belongs to the caller
+    int caller_threads = omp_get_max_threads();
+    if(opt->nthreads > 0)
+        omp_set_num_threads(opt->nthreads);
+#else
+    (void)opt; // only sets the number of threads
+#endif
+
+    struct tessellated_grid grid;
+    f_gta_grid_area(x, nframes, natoms, cell_width, linear ? weight_dist : weight_dist2, &grid);
+
+#ifdef _OPENMP
+    omp_set_num_threads(caller_threads);
+#endif
+
+    *area = grid.surface_area;
+    if(num_empty)  *num_empty = grid.num_empty;
+
+    free_grid(&grid);
+    free_grid_traj(x, nframes);
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ */
+
+#include "gta_mesh.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gkut_log.h"
+#include "smalloc.h"
+
+#define MESHBUF 16 // Default number of encoded frames that can be waiting for the writer thread
+#define INDEXSTEP 1024 // Number of index entries allocated at a time
+
+
+// One encoded frame
+struct mesh_block {
+    int frame, group;
+    size_t size;
+    unsigned char *data;
+};
+
+// Position of a block in the file
+struct mesh_index {
+    int32_t frame;
+    int32_t group;
+    int64_t offset;
+};
+
+struct gta_mesh_writer {
+    FILE *f;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+
+    struct mesh_block *queue; // ring buffer of nbuf blocks waiting to be written
+    int nbuf, head, count;
+    int closing; // set by close_mesh_writer, the writer thread exits once the queue is empty
+
+    struct mesh_index *index; // written by the writer thread only
+    int64_t nindex, index_cap;
+    int64_t offset; // current end of the file
+    int error;
+};
+
+
+static void *writer_thread(void *arg);
+/* Writes the queued blocks to the file until the writer is closed.
+ */
+
+static size_t encode_mesh(int frame, int group, const struct dTriangulation *tri, unsigned char **data);
+/* Encodes a frame block (see gta_mesh.h) into a new buffer stored in data and returns its size.
+ */
+
+
+struct gta_mesh_writer *open_mesh_writer(const char *fname, int nbuf) {
+    const char magic[8] = "GTAMESH";
+    uint32_t byte_order = 0x01020304, version = 1;
+    struct gta_mesh_writer *w;
+
+    FILE *f = fopen(fname, "wb");
+    if(f == NULL) {
+        print_log("Could not open %s for writing\n", fname);
+        return NULL;
+    }
+
+    snew(w, 1);
+    w->f = f;
+    w->nbuf = nbuf > 0 ? nbuf : MESHBUF;
+    snew(w->queue, w->nbuf);
+
+    fwrite(magic, sizeof(magic), 1, f);
+    fwrite(&byte_order, sizeof(byte_order), 1, f);
+    fwrite(&version, sizeof(version), 1, f);
+    w->offset = sizeof(magic) + sizeof(byte_order) + sizeof(version);
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    pthread_create(&w->thread, NULL, writer_thread, w);
+
+    return w;
+}
+
+
+void write_mesh(struct gta_mesh_writer *w, int frame, int group, const struct dTriangulation *tri) {
+    struct mesh_block block;
+
+    block.frame = frame;
+    block.group = group;
+    block.size = encode_mesh(frame, group, tri, &block.data);
+
+    pthread_mutex_lock(&w->lock);
+    while(w->count == w->nbuf)
+        pthread_cond_wait(&w->not_full, &w->lock);
+    w->queue[(w->head + w->count) % w->nbuf] = block;
+    ++w->count;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+}
+
+
+static int compare_index(const void *a, const void *b) {
+    const struct mesh_index *ia = a, *ib = b;
+    if(ia->frame != ib->frame)
+        return (ia->frame > ib->frame) - (ia->frame < ib->frame);
+    return (ia->group > ib->group) - (ia->group < ib->group);
+}
+
+void close_mesh_writer(struct gta_mesh_writer *w) {
+    const char magic[8] = "GTAMIDX";
+
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    qsort(w->index, w->nindex, sizeof(struct mesh_index), compare_index);
+
+    int64_t index_offset = w->offset;
+    fwrite(&w->nindex, sizeof(w->nindex), 1, w->f);
+    fwrite(w->index, sizeof(struct mesh_index), w->nindex, w->f);
+    fwrite(&index_offset, sizeof(index_offset), 1, w->f);
+    fwrite(magic, sizeof(magic), 1, w->f);
+
+    if(w->error || ferror(w->f))
+        print_log("Error writing mesh file\n");
+    else
+        print_log("%ld triangulations saved to mesh file\n", (long)w->nindex);
+    fclose(w->f);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->not_empty);
+    pthread_cond_destroy(&w->not_full);
+    sfree(w->queue);
+    sfree(w->index);
+    sfree(w);
+}
+
+
+static void *writer_thread(void *arg) {
+    struct gta_mesh_writer *w = arg;
+    struct mesh_block block;
+
+    while(1) {
+        pthread_mutex_lock(&w->lock);
+        while(w->count == 0 && !w->closing)
+            pthread_cond_wait(&w->not_empty, &w->lock);
+        if(w->count == 0) { // closing and nothing left to write
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        block = w->queue[w->head];
+        w->head = (w->head + 1) % w->nbuf;
+        --w->count;
+        pthread_cond_signal(&w->not_full);
+        pthread_mutex_unlock(&w->lock);
+
+        // only this thread touches the file and the index until it exits
+        if(w->nindex == w->index_cap) {
+            w->index_cap += INDEXSTEP;
+            srenew(w->index, w->index_cap);
+        }
+        w->index[w->nindex].frame = block.frame;
+        w->index[w->nindex].group = block.group;
+        w->index[w->nindex].offset = w->offset;
+        ++w->nindex;
+
+        if(fwrite(block.data, 1, block.size, w->f) != block.size)
+            w->error = 1;
+        w->offset += block.size;
+        sfree(block.data);
+    }
+
+    return NULL;
+}
+
+
+static inline unsigned char *put_varint(unsigned char *p, uint32_t v) {
+    while(v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static size_t encode_mesh(int frame, int group, const struct dTriangulation *tri, unsigned char **data) {
+    int32_t head[4] = {frame, group, tri->npoints, tri->ntriangles};
+    uint32_t nbytes;
+    size_t points_size = 2 * tri->npoints * sizeof(float);
+    size_t head_size = sizeof(head) + sizeof(nbytes);
+
+    // a varint of a zigzag-encoded 32-bit difference takes at most 5 bytes
+    snew(*data, head_size + points_size + 5 * 3 * (size_t)tri->ntriangles);
+
+    float *points = (float*)(*data + head_size);
+    for(int i = 0; i < tri->npoints; ++i) {
+        dtreal xy[2];
+        dtpoint(tri, i, xy);
+        points[2*i] = xy[0];
+        points[2*i+1] = xy[1];
+    }
+
+    unsigned char *start = *data + head_size + points_size, *p = start;
+    int32_t prev = 0;
+    for(int i = 0; i < 3 * tri->ntriangles; ++i) {
+        int32_t d = tri->triangles[i] - prev;
+        p = put_varint(p, d >= 0 ? 2 * (uint32_t)d : 2 * (uint32_t)(-(d + 1)) + 1);
+        prev = tri->triangles[i];
+    }
+    nbytes = p - start;
+
+    memcpy(*data, head, sizeof(head));
+    memcpy(*data + sizeof(head), &nbytes, sizeof(nbytes));
+
+    return head_size + points_size + nbytes;
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ */
+
+#include "gta_stats.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "gkut_log.h"
+#include "smalloc.h"
+
+#define MIN_BLOCKS 32 // Fewest blocks of a block size for its standard error to count for the block standard error
+
+
+static void moments_add(struct gta_moments *m, double x) {
+    ++m->n;
+    double delta = x - m->mean;
+    m->mean += delta / m->n;
+    m->m2 += delta * (x - m->mean);
+}
+
+// Chan, Golub and LeVeque's pairwise update of the moments of the union of two sets
+static void moments_merge(struct gta_moments *dst, const struct gta_moments *src) {
+    if(src->n == 0)
+        return;
+    if(dst->n == 0) {
+        *dst = *src;
+        return;
+    }
+    long n = dst->n + src->n;
+    double delta = src->mean - dst->mean;
+    dst->mean += delta * src->n / n;
+    dst->m2 += src->m2 + delta * delta * ((double)dst->n * src->n / n);
+    dst->n = n;
+}
+
+static double moments_var(const struct gta_moments *m) {
+    return m->n > 1 ? m->m2 / (m->n - 1) : 0;
+}
+
+static double moments_stderr(const struct gta_moments *m) {
+    return m->n > 1 ? sqrt(moments_var(m) / m->n) : 0;
+}
+
+static void series_init(struct gta_series *s) {
+    memset(s, 0, sizeof(*s));
+    s->min = HUGE_VAL;
+    s->max = -HUGE_VAL;
+}
+
+static void series_add(struct gta_series *s, double x) {
+    if(x < s->min)  s->min = x;
+    if(x > s->max)  s->max = x;
+
+    // x is the average of a block of 2^k frames, which pairs up with the carry of level k if there is one
+    for(int k = 0; k < GTA_BLOCK_LEVELS; ++k) {
+        moments_add(&s->block[k], x);
+        if(!s->has_carry[k]) {
+            s->carry[k] = x;
+            s->has_carry[k] = 1;
+            break;
+        }
+        x = (s->carry[k] + x) / 2;
+        s->has_carry[k] = 0;
+    }
+}
+
+static void series_merge(struct gta_series *dst, const struct gta_series *src) {
+    if(src->min < dst->min)  dst->min = src->min;
+    if(src->max > dst->max)  dst->max = src->max;
+
+    for(int k = 0; k < GTA_BLOCK_LEVELS; ++k) {
+        moments_merge(&dst->block[k], &src->block[k]);
+        // blocks keep the alignment of src, so the carry of dst has no partner
+        dst->carry[k] = src->carry[k];
+        dst->has_carry[k] = src->has_carry[k];
+    }
+}
+
+// Largest standard error of the block sizes with at least MIN_BLOCKS blocks
+static double series_block_stderr(const struct gta_series *s) {
+    double se = moments_stderr(&s->block[0]);
+    for(int k = 1; k < GTA_BLOCK_LEVELS && s->block[k].n >= MIN_BLOCKS; ++k) {
+        double sek = moments_stderr(&s->block[k]);
+        if(sek > se)  se = sek;
+    }
+    return se;
+}
+
+static void hist_add(struct gta_hist *h, const struct gta_stats *stats, double x) {
+    if(x < stats->hist_min) {
+        ++h->under;
+    }
+    else {
+        double bin = (x - stats->hist_min) / (stats->hist_max - stats->hist_min) * stats->hist_bins;
+        if(bin < stats->hist_bins)  ++h->count[(int)bin];
+        else                        ++h->over;
+    }
+}
+
+
+void gta_stats_init(struct gta_stats *stats, double hist_min, double hist_max, int hist_bins) {
+    memset(stats, 0, sizeof(*stats));
+    stats->hist_min = hist_min;
+    stats->hist_max = hist_max > hist_min ? hist_max : hist_min + 1;
+    stats->hist_bins = hist_bins > 0 ? hist_bins : 1;
+    series_init(&stats->box);
+}
+
+void gta_stats_groups(struct gta_stats *stats, int ngroups, const int *group_natoms, int has2D) {
+    stats->ngroups = ngroups;
+    snew(stats->group_natoms, ngroups);
+    memcpy(stats->group_natoms, group_natoms, ngroups * sizeof(int));
+
+    snew(stats->area, ngroups);
+    for(int g = 0; g < ngroups; ++g)  series_init(&stats->area[g]);
+    if(has2D) {
+        snew(stats->area2D, ngroups);
+        for(int g = 0; g < ngroups; ++g)  series_init(&stats->area2D[g]);
+    }
+
+    snew(stats->hist, ngroups);
+    for(int g = 0; g < ngroups; ++g)  snew(stats->hist[g].count, stats->hist_bins);
+}
+
+void gta_stats_clone(struct gta_stats *dst, const struct gta_stats *src) {
+    gta_stats_init(dst, src->hist_min, src->hist_max, src->hist_bins);
+    gta_stats_groups(dst, src->ngroups, src->group_natoms, src->area2D != NULL);
+}
+
+void gta_stats_add(struct gta_stats *stats, int group, double a3D, double a2D) {
+    series_add(&stats->area[group], a3D);
+    if(stats->area2D)
+        series_add(&stats->area2D[group], a2D);
+    hist_add(&stats->hist[group], stats, a3D / stats->group_natoms[group]);
+}
+
+void gta_stats_add_box(struct gta_stats *stats, double a2Dbox) {
+    series_add(&stats->box, a2Dbox);
+}
+
+void gta_stats_merge(struct gta_stats *dst, const struct gta_stats *src) {
+    for(int g = 0; g < dst->ngroups; ++g) {
+        series_merge(&dst->area[g], &src->area[g]);
+        if(dst->area2D)
+            series_merge(&dst->area2D[g], &src->area2D[g]);
+
+        struct gta_hist *h = &dst->hist[g];
+        for(int i = 0; i < dst->hist_bins; ++i)  h->count[i] += src->hist[g].count[i];
+        h->under += src->hist[g].under;
+        h->over += src->hist[g].over;
+    }
+    series_merge(&dst->box, &src->box);
+}
+
+
+// A quantity of the summary, which is a series scaled by 1/natoms for the areas per particle
+struct column {
+    char name[32];
+    const struct gta_series *s;
+    double scale;
+};
+
+static void column_name(char *name, const char *prefix, int g, int ngroups) {
+    if(ngroups > 1)  sprintf(name, "%s[%d]", prefix, g);
+    else             strcpy(name, prefix);
+}
+
+void gta_stats_print(const char *fname, const struct gta_stats *stats) {
+    FILE *f = fopen(fname, "w");
+    if(!f) {
+        print_log("Could not open %s for writing\n", fname);
+        return;
+    }
+
+    int ncols = 0;
+    struct column *cols;
+    snew(cols, 4 * stats->ngroups + 1);
+    for(int g = 0; g < stats->ngroups; ++g) {
+        column_name(cols[ncols].name, "AREA", g, stats->ngroups);
+        cols[ncols].s = &stats->area[g];
+        cols[ncols++].scale = 1;
+        column_name(cols[ncols].name, "AREA/PARTICLE", g, stats->ngroups);
+        cols[ncols].s = &stats->area[g];
+        cols[ncols++].scale = 1.0 / stats->group_natoms[g];
+        if(stats->area2D) {
+            column_name(cols[ncols].name, "2DAREA", g, stats->ngroups);
+            cols[ncols].s = &stats->area2D[g];
+            cols[ncols++].scale = 1;
+            column_name(cols[ncols].name, "2DAREA/PARTICLE", g, stats->ngroups);
+            cols[ncols].s = &stats->area2D[g];
+            cols[ncols++].scale = 1.0 / stats->group_natoms[g];
+        }
+    }
+    strcpy(cols[ncols].name, "BOX-AREA");
+    cols[ncols].s = &stats->box;
+    cols[ncols++].scale = 1;
+
+    fprintf(f, "# Statistics of %ld frames\n", stats->box.block[0].n);
+    fprintf(f, "# QUANTITY\tMEAN\tSTDDEV\tMIN\tMAX\tSTDERR\tBLOCK-STDERR\n");
+    for(int c = 0; c < ncols; ++c) {
+        const struct gta_series *s = cols[c].s;
+        double sc = cols[c].scale;
+        fprintf(f, "%s\t%f\t%f\t%f\t%f\t%f\t%f\n", cols[c].name,
+            sc * s->block[0].mean, sc * sqrt(moments_var(&s->block[0])),
+            s->block[0].n > 0 ? sc * s->min : 0, s->block[0].n > 0 ? sc * s->max : 0,
+            sc * moments_stderr(&s->block[0]), sc * series_block_stderr(s));
+    }
+
+    fprintf(f, "\n# Standard error of the mean from the averages of blocks of consecutive frames\n");
+    fprintf(f, "# FRAMES\tBLOCKS");
+    for(int c = 0; c < ncols; ++c)
+        fprintf(f, "\t%s", cols[c].name);
+    fprintf(f, "\n");
+    for(int k = 0; k < GTA_BLOCK_LEVELS && stats->box.block[k].n > 1; ++k) {
+        fprintf(f, "%ld\t%ld", 1L << k, stats->box.block[k].n);
+        for(int c = 0; c < ncols; ++c)
+            fprintf(f, "\t%f", cols[c].scale * moments_stderr(&cols[c].s->block[k]));
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "\n# Histogram of the area per particle\n");
+    fprintf(f, "# AREA/PARTICLE");
+    for(int g = 0; g < stats->ngroups; ++g) {
+        if(stats->ngroups > 1)  fprintf(f, "\tCOUNT[%d]\tFRACTION[%d]", g, g);
+        else                    fprintf(f, "\tCOUNT\tFRACTION");
+    }
+    fprintf(f, "\n");
+    double width = (stats->hist_max - stats->hist_min) / stats->hist_bins;
+    for(int i = 0; i < stats->hist_bins; ++i) {
+        fprintf(f, "%f", stats->hist_min + (i + 0.5) * width);
+        for(int g = 0; g < stats->ngroups; ++g) {
+            long n = stats->area[g].block[0].n;
+            fprintf(f, "\t%ld\t%f", stats->hist[g].count[i], n > 0 ? (double)stats->hist[g].count[i] / n : 0);
+        }
+        fprintf(f, "\n");
+    }
+    for(int g = 0; g < stats->ngroups; ++g) {
+        if(stats->hist[g].under > 0 || stats->hist[g].over > 0) {
+            if(stats->ngroups > 1)  fprintf(f, "# Group %d: ", g);
+            else                    fprintf(f, "# ");
+            fprintf(f, "%ld frames below %f and %ld frames at or above %f\n",
+                stats->hist[g].under, stats->hist_min, stats->hist[g].over, stats->hist_max);
+        }
+    }
+
+    for(int g = 0; g < stats->ngroups; ++g) {
+        const struct gta_series *s = &stats->area[g];
+        double apl = s->block[0].mean / stats->group_natoms[g], se = series_block_stderr(s) / stats->group_natoms[g];
+        if(stats->ngroups > 1) {
+            print_log("Average surface area of group %d: %f\n", g, s->block[0].mean);
+            print_log("Average area per particle of group %d: %f +- %f\n", g, apl, se);
+        }
+        else {
+            print_log("Average surface area: %f\n", s->block[0].mean);
+            print_log("Average area per particle: %f +- %f\n", apl, se);
+        }
+    }
+
+    sfree(cols);
+    fclose(f);
+    print_log("Area statistics saved to %s\n", fname);
+}
+
+void gta_stats_free(struct gta_stats *stats) {
+    for(int g = 0; g < stats->ngroups; ++g)  sfree(stats->hist[g].count);
+    sfree(stats->hist);
+    sfree(stats->area);
+    sfree(stats->area2D);
+    sfree(stats->group_natoms);
+    stats->ngroups = 0;
+}
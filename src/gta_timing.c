@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ */
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include "gta_timing.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gkut_log.h"
+
+int gta_timing_on = 0;
+int gta_timing_nslots = 0;
+struct gta_timing_slot *gta_timing_slots = NULL;
+
+static const char *stage_names[GTA_T_NUM] = {
+    "read trajectory", "edge correction", "sort points", "merge triangulation",
+    "incremental repair", "triangle list", "area summation", "output", "frames"
+};
+
+
+void gta_timing_init(int nthreads) {
+    int nslots = nthreads > 0 ? nthreads : 1;
+#ifdef _OPENMP
+    // a slot for every thread that any parallel region could start
+    if(omp_get_max_threads() > nslots)  nslots = omp_get_max_threads();
+    if(omp_get_num_procs() > nslots)    nslots = omp_get_num_procs();
+#endif
+
+    free(gta_timing_slots);
+    gta_timing_slots = calloc(nslots, sizeof(struct gta_timing_slot));
+    gta_timing_nslots = nslots;
+    gta_timing_on = 1;
+}
+
+double gta_timing_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static double percent(long part, long total) {
+    return total > 0 ? 100.0 * part / total : 0;
+}
+
+void gta_timing_report() {
+    struct gta_timing_slot sum;
+    memset(&sum, 0, sizeof(sum));
+
+    if(!gta_timing_on)
+        return;
+
+    int nbusy = 0; // threads that triangulated at least one frame
+    double busy_min = 0, busy_max = 0, busy_sum = 0;
+    for(int t = 0; t < gta_timing_nslots; ++t) {
+        const struct gta_timing_slot *s = &gta_timing_slots[t];
+        for(int i = 0; i < GTA_T_NUM; ++i)  sum.time[i] += s->time[i];
+        for(int i = 0; i < GTA_C_NUM; ++i)  sum.count[i] += s->count[i];
+
+        if(s->count[GTA_C_FRAMES] > 0) {
+            double busy = s->time[GTA_T_FRAME];
+            busy_min = nbusy == 0 || busy < busy_min ? busy : busy_min;
+            busy_max = busy > busy_max ? busy : busy_max;
+            busy_sum += busy;
+            ++nbusy;
+        }
+    }
+
+    print_log("\nWall-clock time by stage, summed over all threads:\n");
+    for(int i = 0; i < GTA_T_NUM; ++i) {
+        print_log("  %-20s %12.6f s\n", stage_names[i], sum.time[i]);
+    }
+
+    long orient = sum.count[GTA_C_ORIENT_FAST] + sum.count[GTA_C_ORIENT_EXACT];
+    long incircle = sum.count[GTA_C_INCIRCLE_FAST] + sum.count[GTA_C_INCIRCLE_EXACT];
+    print_log("orient2d calls: %ld, %ld filtered (%.3f%%), %ld exact\n", orient,
+        sum.count[GTA_C_ORIENT_FAST], percent(sum.count[GTA_C_ORIENT_FAST], orient), sum.count[GTA_C_ORIENT_EXACT]);
+    print_log("incircle calls: %ld, %ld filtered (%.3f%%), %ld exact\n", incircle,
+        sum.count[GTA_C_INCIRCLE_FAST], percent(sum.count[GTA_C_INCIRCLE_FAST], incircle), sum.count[GTA_C_INCIRCLE_EXACT]);
+    print_log("Quad-edges allocated: %ld, edge flips: %ld, duplicate points removed: %ld\n",
+        sum.count[GTA_C_EDGES], sum.count[GTA_C_FLIPS], sum.count[GTA_C_DUPLICATES]);
+
+    if(nbusy > 0) {
+        double busy_mean = busy_sum / nbusy;
+        print_log("Frame loop: %ld frames on %d threads, busy time min %f s, mean %f s, max %f s, imbalance %.1f%%\n",
+            sum.count[GTA_C_FRAMES], nbusy, busy_min, busy_mean, busy_max,
+            busy_mean > 0 ? 100 * (busy_max / busy_mean - 1) : 0);
+        for(int t = 0; t < gta_timing_nslots; ++t) {
+            const struct gta_timing_slot *s = &gta_timing_slots[t];
+            if(s->count[GTA_C_FRAMES] > 0)
+                print_log("  thread %3d: %8ld frames %12.6f s\n", t, s->count[GTA_C_FRAMES], s->time[GTA_T_FRAME]);
+        }
+    }
+}
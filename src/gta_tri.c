@@ -12,18 +12,193 @@
 #include "gta_tri.h"
 
 #include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#if defined __AVX512F__ || defined __AVX__
+#include <immintrin.h>
+#endif
 #ifdef GTA_BENCH
 #include <time.h>
 #endif
+#ifdef GTA_MPI
+#include <mpi.h>
+#endif
 #include "gkut_io.h"
 #include "gkut_log.h"
 #include "smalloc.h"
 #include "delaunay_tri.h"
+#include "gta_mesh.h"
+#include "gta_timing.h"
+#include "gta_vertex.h"
+
+#define STREAMBUF 4 // Default number of frames per thread that can be in flight in streaming mode
+#define AREABLOCK 256 // Number of triangles gathered at a time by sum_tri_areas, must be a multiple of 8
+#define PRINTBUF (1 << 20) // Size in bytes of the output buffer of print_areas
+#define BINALIGN 64 // Alignment of the first column of print_areas_bin files
+
+
+// Per-thread buffers that are reused for every frame
+struct gta_workspace {
+    struct dtWorkspace *dt; // triangulation buffers
+    rvec *edge; // corner and edge points added by add_edge_points
+    int edge_cap;
+    real *bounds; // min and max coordinates per edge interval (see add_edge_points)
+    int *bound_inds; // indexes of the atoms with those coordinates
+    int bounds_cap;
+    rvec *x; // coordinates of a frame gathered from a caller's buffer (see frame_coords)
+    int x_cap;
+    struct gta_mesh_writer *mesh; // NULL unless the triangulations are exported
+    struct gta_vertex_writer *vertex; // NULL unless the areas of the atoms are exported
+    double *vert; // area of each atom of a frame (see sum_tri_areas)
+    float *fvert; // the same rounded to float for the vertex writer
+    int vert_cap;
+};
+
+// See gtessla.h
+struct gta_context {
+    struct gta_options opt;
+    struct gta_workspace **ws; // [nws] one per thread, each allocated by the thread that uses it (see context_ws)
+    int nws;
+};
+
+
+static int init_threads(int nthreads);
+/* Sets the number of OpenMP threads if built with openmp.
+ * Returns the number of threads of the calling thread before, which belongs to the caller (see restore_threads).
+ */
+
+static void restore_threads(int caller_threads);
+/* Sets the number of OpenMP threads back to the one returned by init_threads.
+ */
+
+static inline int thread_num() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static struct gta_workspace *gta_ws_new();
+/* Allocates an empty per-thread workspace. Call gta_ws_free when done.
+ */
 
+static void gta_ws_free(struct gta_workspace *ws);
+
+static int context_threads(struct gta_context *ctx);
+/* Returns the number of threads of the parallel regions of ctx and makes room for their workspaces.
+ */
+
+static inline struct gta_workspace *context_ws(struct gta_context *ctx) {
+    int t = thread_num();
+    if(ctx->ws[t] == NULL)
+        ctx->ws[t] = gta_ws_new();
+    return ctx->ws[t];
+}
+
+static void set_schedule(const struct gta_options *opt);
+/* Sets the OpenMP schedule(runtime) of the calling thread to the schedule in opt.
+ */
+
+static const rvec *frame_coords(struct gta_workspace *ws, const float *xyz, int natoms, size_t stride);
+/* Returns the coordinates of a frame in a caller's buffer as an rvec array, 
+ * which are gathered into ws->x unless the buffer already has that layout.
+ */
+
+static void surface_area(const rvec *x, 
+                         int natoms, 
+                         const rvec *edge, 
+                         int nedge, 
+                         unsigned char flags, 
+                         int frame, 
+                         int group, 
+                         struct gta_mesh_writer *mesh, 
+                         real *a2D, 
+                         real *a3D, 
+                         double *vert, 
+                         struct dtWorkspace *ws);
+/* Same as delaunay_surface_area_ws, but the nedge points in edge are tessellated 
+ * together with the natoms points in x, as if they had been appended to x.
+ * frame and group number the files of GTA_PRINT, and the triangulation is passed to mesh unless it is NULL.
+ * The areas of the atoms are added to vert unless it is NULL (see sum_tri_areas).
+ */
+
+static void sum_tri_areas(const rvec *x, 
+                          int natoms, 
+                          const rvec *edge, 
+                          const struct dTriangulation *tri, 
+                          real *a2D, 
+                          real *a3D, 
+                          double *vert);
+/* Sums the areas of the triangles in tri, whose points are x followed by edge.
+ * a2D gets the sum of the areas projected on the xy-plane, a3D the sum of the 3D areas.
+ * Either can be NULL.
+ * Unless vert is NULL, the 3D area of each triangle is also split evenly between those of its points that are atoms
+ * and added to the natoms values in vert (see gta_vertex.h).
+ */
+
+static void area_block(const double *e, double *a2D, double *a3D, double *t3D);
+/* Adds the 2D and 3D areas of AREABLOCK triangles to a2D and a3D, 
+ * without halving them (see sum_tri_areas).
+ * e holds the triangle edge vectors in structure-of-arrays layout: 
+ * abx, aby, abz, acx, acy and acz arrays of AREABLOCK doubles each.
+ * Unless t3D is NULL, the unhalved 3D area of each triangle is stored in its AREABLOCK values.
+ */
+
+static void tessellate_frame(const rvec *x, 
+                             matrix box, 
+                             int natoms, 
+                             real espace, 
+                             unsigned char flags, 
+                             int frame, 
+                             int group, 
+                             struct gta_workspace *ws, 
+                             real *a2Dbox, 
+                             real *a2D, 
+                             real *a3D);
+/* Tessellates one group of one frame using the buffers in ws and stores its box area, 2D area and 3D area.
+ * a2Dbox can be NULL.
+ * If GTA_CORRECT is set, edge correction points are tessellated along with x (see add_edge_points).
+ * x is not modified.
+ */
+
+static int add_edge_points(const rvec *x, 
+                           matrix box, 
+                           int natoms, 
+                           real espace, 
+                           struct gta_workspace *ws);
+/* Generates corner and edge points along the box boundary for periodic bounds correction
+ * and stores them in ws->edge. Returns the number of generated points.
+ */
+
+static void store_frame_areas(struct tri_area *areas, int *cap, int fr, const real *area, const real *area2D, real area2Dbox);
+/* Stores the areas of the groups of frame fr, and its box area, in the arrays of areas, 
+ * growing them to a capacity of *cap frames if needed, or adds them to areas->stats if it is set.
+ * area2D can be NULL. Frames have to be stored in order. Sets areas->nframes to fr + 1.
+ */
+
+static void print_group_areas(const char *fname, const struct tri_area *areas);
+/* print_areas for more than one group.
+ */
+
+static void print_areas_header(FILE *f, const struct tri_area *areas);
+/* Prints the column names of print_areas.
+ */
+
+static void print_areas_row(FILE *f, const struct tri_area *areas, int fr);
+/* Prints the line of print_areas for frame fr.
+ */
+
+static inline int edge_interval(real c, real len, int n) {
+    int i = (int)((c / len) * n);
+    return i < 0 ? 0 : (i > n ? n : i); // atoms outside of the box belong to the nearest interval
+}
 
 void print_triangulation3D(const rvec *x, 
                            matrix box, 
@@ -40,34 +215,28 @@ void print_dtrifiles(const struct dTriangulation *tri,
 
 void tessellate_area(const char *traj_fname, 
                      const char *ndx_fname, 
+                     int ngroups, 
                      output_env_t *oenv, 
-                     real espace, 
-                     int nthreads, 
-                     struct tri_area *areas, 
-                     unsigned char flags) {
-    rvec **pre_x, **x;
+                     int skip, 
+                     const struct gta_options *opt, 
+                     const char *mesh_fname, 
+                     const char *vertex_fname, 
+                     struct tri_area *areas) {
+    rvec **x;
     matrix *box;
 
     areas->area = NULL;
     areas->area2D = NULL;
     areas->area2Dbox = NULL;
 
-    read_traj(traj_fname, &pre_x, &box, &(areas->nframes), &(areas->natoms), oenv);
+    // Filter trajectory by index file if present, while it is read
+    double start = gta_tic();
+    read_traj_ndx(traj_fname, ndx_fname, ngroups, &x, &box, &(areas->nframes), &(areas->natoms), 
+        &(areas->group_natoms), oenv, skip);
+    gta_toc(GTA_T_READ, start);
+    areas->ngroups = ndx_fname && ngroups > 1 ? ngroups : 1;
 
-    // Filter trajectory by index file if present
-    if(ndx_fname != NULL) {
-        ndx_filter_traj(ndx_fname, pre_x, &x, areas->nframes, &(areas->natoms));
-
-        for(int i = 0; i < areas->nframes; ++i) {
-            sfree(pre_x[i]);
-        }
-        sfree(pre_x);
-    }
-    else {
-        x = pre_x;
-    }
-
-    delaunay_tessellate(x, box, espace, nthreads, areas, flags);
+    delaunay_tessellate(x, box, opt, mesh_fname, vertex_fname, areas);
 
     for(int i = 0; i < areas->nframes; ++i) {
         sfree(x[i]);
@@ -77,250 +246,380 @@ void tessellate_area(const char *traj_fname,
 }
 
 
-void delaunay_tessellate(rvec **x, 
-                         matrix *box, 
-                         real espace, 
-                         int nthreads, 
-                         struct tri_area *areas, 
-                         unsigned char flags) {
+void stream_tessellate_area(const char *traj_fname, 
+                            const char *ndx_fname, 
+                            int ngroups, 
+                            output_env_t *oenv, 
+                            int skip, 
+                            const struct gta_options *opt, 
+                            int nbuf, 
+                            const char *mesh_fname, 
+                            const char *vertex_fname, 
+                            struct tri_area *areas) {
 #ifdef GTA_BENCH
     clock_t start = clock();
 #endif
 
-#ifdef _OPENMP
-    if(nthreads > 0)
-        omp_set_num_threads(nthreads);
-    if(nthreads > 1 || nthreads <= 0)
-        print_log("Triangulation will be parallelized.\n");
-#endif
-
-    // Calculate triangulated surface area for every frame
-    dtinit(); // Initialize the delaunay triangulator
-    snew(areas->area, areas->nframes);
-    snew(areas->area2Dbox, areas->nframes);
-    if(flags & GTA_2D)  snew(areas->area2D, areas->nframes);
-
-    if(flags & GTA_CORRECT) { // add correction for periodic bounds
-        print_log("Triangulating and correcting %d frames...\n", areas->nframes);
+    struct traj_stream stream;
+    rvec **x;
+    matrix *box;
+    int cap = 0;
 
-#pragma omp parallel for shared(areas,x,flags)
-        for(int fr = 0; fr < areas->nframes; ++fr) {
-#if defined _OPENMP && defined GTA_DEBUG
-            print_log("%d threads triangulating.\n", omp_get_num_threads());
-#endif
-            // Calculate number of edge points
-            int n_edge_x = box[fr][0][0] / espace;
-            int n_edge_y = box[fr][1][1] / espace;
-
-            // Calculate box area
-            areas->area2Dbox[fr] = box[fr][0][0] * box[fr][1][1];
-
-            // z-coordinates of particles closest to box corners
-            real bot_left = FLT_MAX, top_right = FLT_MIN, 
-                top_left = FLT_MAX, bot_right = FLT_MIN, 
-                avg_z;
-            int bot_left_ind = 0, top_right_ind = 0, top_left_ind = 0, bot_right_ind = 0;
-            
-            // Find min max coordinates for each interval
-            real *y_mins, *y_maxes, *x_mins, *x_maxes;
-            snew(y_mins, n_edge_x + 1);
-            snew(y_maxes, n_edge_x + 1);
-            snew(x_mins, n_edge_y + 1);
-            snew(x_maxes, n_edge_y + 1);
-
-            int *y_min_inds, *y_max_inds, *x_min_inds, *x_max_inds;
-            snew(y_min_inds, n_edge_x + 1);
-            snew(y_max_inds, n_edge_x + 1);
-            snew(x_min_inds, n_edge_y + 1);
-            snew(x_max_inds, n_edge_y + 1);
-
-            for(int i = 0; i <= n_edge_x; ++i)
-                y_mins[i] = FLT_MAX;
-            for(int i = 0; i <= n_edge_x; ++i)
-                y_maxes[i] = FLT_MIN;
-            for(int i = 0; i <= n_edge_y; ++i)
-                x_mins[i] = FLT_MAX;
-            for(int i = 0; i <= n_edge_y; ++i)
-                x_maxes[i] = FLT_MIN;
-
-            memset(y_min_inds, 0, sizeof(int) * (n_edge_x + 1));
-            memset(y_max_inds, 0, sizeof(int) * (n_edge_x + 1));
-            memset(x_min_inds, 0, sizeof(int) * (n_edge_y + 1));
-            memset(x_max_inds, 0, sizeof(int) * (n_edge_y + 1));
-
-            real dist, dY;
-            int x_interval, y_interval;
-            for(int j = 0; j < areas->natoms; ++j) {
-                // min and max distance from origin
-                dist = x[fr][j][XX] * x[fr][j][XX] + x[fr][j][YY] * x[fr][j][YY];
-                if(dist < bot_left) {
-                    bot_left = dist;
-                    bot_left_ind = j;
-                }
-                if(dist > top_right) {
-                    top_right = dist;
-                    top_right_ind = j;
-                }
+    areas->area = NULL;
+    areas->area2D = NULL;
+    areas->area2Dbox = NULL;
+    areas->nframes = 0;
+
+    open_traj_stream(traj_fname, ndx_fname, ngroups, oenv, skip, &stream);
+    areas->natoms = stream.natoms;
+    areas->ngroups = stream.ngroups;
+    snew(areas->group_natoms, stream.ngroups);
+    memcpy(areas->group_natoms, stream.isize, stream.ngroups * sizeof(int));
+
+    // offset of each group in the frames
+    int *group_start;
+    snew(group_start, areas->ngroups);
+    for(int g = 1; g < areas->ngroups; ++g) {
+        group_start[g] = group_start[g-1] + areas->group_natoms[g-1];
+    }
 
-                // min and max distance from top left corner
-                dY = box[fr][1][1] - x[fr][j][YY];
-                dist = x[fr][j][XX] * x[fr][j][XX] + dY * dY;
-                if(dist < top_left) {
-                    top_left = dist;
-                    top_left_ind = j;
-                }
-                if(dist > bot_right) {
-                    bot_right = dist;
-                    bot_right_ind = j;
-                }
+    int caller_threads = init_threads(opt->nthreads);
+    unsigned char flags = opt->flags;
 
-                // Check min max y in x interval
-                x_interval = (int)((x[fr][j][XX] / box[fr][0][0]) * n_edge_x);
+    if(areas->stats)
+        gta_stats_groups(areas->stats, areas->ngroups, areas->group_natoms, flags & GTA_2D);
 
-                if(x[fr][j][YY] < y_mins[x_interval]) {
-                    y_mins[x_interval] = x[fr][j][YY];
-                    y_min_inds[x_interval] = j;
-                }
+    struct gta_context *ctx = gta_context_new(opt);
+    int nthreads = context_threads(ctx);
 
-                if(x[fr][j][YY] > y_maxes[x_interval]) {
-                    y_maxes[x_interval] = x[fr][j][YY];
-                    y_max_inds[x_interval] = j;
-                }
+    if(nbuf <= 0)
+        nbuf = STREAMBUF * nthreads;
 
-                // Check min max x in y interval
-                y_interval = (int)((x[fr][j][YY] / box[fr][1][1]) * n_edge_y);
-                
-                if(x[fr][j][XX] < x_mins[y_interval]) {
-                    x_mins[y_interval] = x[fr][j][XX];
-                    x_min_inds[y_interval] = j;
+    // Slot k holds frame k, k + nbuf, k + 2 * nbuf, ... and the areas of its groups until they are stored.
+    // A slot is reused as soon as the tasks of its last frame are done, so up to nbuf frames are always in flight.
+    // Only the reading thread touches the arrays of areas, which can then grow while tasks are running.
+    real *slot_area, *slot_area2D = NULL, *slot_box;
+    char *slot_dep; // task dependences of each slot
+    snew(x, nbuf);
+    snew(box, nbuf);
+    for(int i = 0; i < nbuf; ++i) {
+        snew(x[i], stream.natoms);
+    }
+    snew(slot_area, nbuf * areas->ngroups);
+    if(flags & GTA_2D)  snew(slot_area2D, nbuf * areas->ngroups);
+    snew(slot_box, nbuf);
+    snew(slot_dep, nbuf);
+
+    print_log("Streaming and triangulating frames with %d frame buffer(s)...\n", nbuf);
+
+    struct gta_mesh_writer *mesh = mesh_fname ? open_mesh_writer(mesh_fname, nbuf) : NULL;
+    struct gta_vertex_writer *vertex = vertex_fname 
+        ? open_vertex_writer(vertex_fname, areas->natoms, areas->ngroups, areas->group_natoms) : NULL;
+
+#pragma omp parallel num_threads(nthreads) shared(areas,x,box,stream,cap,flags,ctx,mesh,vertex,group_start,slot_area,slot_area2D,slot_box,slot_dep)
+    {
+        context_ws(ctx)->mesh = mesh;
+        context_ws(ctx)->vertex = vertex;
+#pragma omp barrier
+
+#pragma omp single
+        {
+            int nread = 0;
+            while(TRUE) {
+                int slot = nread % nbuf;
+                if(nread >= nbuf) { // the thread helps with the tasks of the frame in the slot until they are done
+#pragma omp taskwait depend(inout: slot_dep[slot])
+                    store_frame_areas(areas, &cap, nread - nbuf, slot_area + slot * areas->ngroups, 
+                        slot_area2D ? slot_area2D + slot * areas->ngroups : NULL, slot_box[slot]);
                 }
 
-                if(x[fr][j][XX] > x_maxes[y_interval]) {
-                    x_maxes[y_interval] = x[fr][j][XX];
-                    x_max_inds[y_interval] = j;
+                double start = gta_tic();
+                gmx_bool more = read_traj_stream(&stream, x[slot], box[slot]);
+                gta_toc(GTA_T_READ, start);
+                if(!more)
+                    break;
+
+                // hand each group to a worker as soon as the frame is read
+                int fr = nread++;
+                for(int g = 0; g < areas->ngroups; ++g) {
+#pragma omp task firstprivate(slot,fr,g) depend(in: slot_dep[slot])
+                    {
+                        int i = slot * areas->ngroups + g;
+                        tessellate_frame(x[slot] + group_start[g], box[slot], areas->group_natoms[g], opt->espace, flags, 
+                            fr, g, context_ws(ctx), g == 0 ? &slot_box[slot] : NULL, 
+                            slot_area2D ? &slot_area2D[i] : NULL, &slot_area[i]);
+                    }
                 }
             }
 
-            sfree(y_mins);
-            sfree(y_maxes);
-            sfree(x_mins);
-            sfree(x_maxes);
-
-            avg_z = ( x[fr][bot_left_ind][ZZ] 
-                    + x[fr][top_right_ind][ZZ] 
-                    + x[fr][top_left_ind][ZZ] 
-                    + x[fr][bot_right_ind][ZZ]) / 4.0;
-
-            // add edge and corner points
-
-            srenew(x[fr], areas->natoms + 2 * (n_edge_x + 1) + 2 * (n_edge_y + 1));
-            int n = areas->natoms;
-
-            // Add corner points
-            x[fr][n][XX]    = 0;
-            x[fr][n][YY]    = 0;
-            x[fr][n++][ZZ]  = avg_z;
-
-            x[fr][n][XX]    = box[fr][0][0];
-            x[fr][n][YY]    = 0;
-            x[fr][n++][ZZ]  = avg_z;
-
-            x[fr][n][XX]    = box[fr][0][0];
-            x[fr][n][YY]    = box[fr][1][1];
-            x[fr][n++][ZZ]  = avg_z;
-
-            x[fr][n][XX]    = 0;
-            x[fr][n][YY]    = box[fr][1][1];
-            x[fr][n++][ZZ]  = avg_z;
-
-            // Add edge points
-            real dist1, dist2;
-            for(int j = 0; j < n_edge_x; ++j) {
-                // Bottom edge
-                x[fr][n][XX] = j * espace + espace / 2; // Go to middle of interval
-                x[fr][n][YY] = 0;
-                // edge Z coord is distance-from-edge-weighted average between the Zs of the two points closest to the two edges of this axis
-                dist1 = x[fr][y_min_inds[j]][YY];
-                dist2 = box[fr][1][1] - x[fr][y_max_inds[j]][YY];
-                dist = dist1 + dist2;
-                avg_z = x[fr][y_min_inds[j]][ZZ] - (dist1/dist)*(x[fr][y_min_inds[j]][ZZ]) 
-                      + x[fr][y_max_inds[j]][ZZ] - (dist2/dist)*(x[fr][y_max_inds[j]][ZZ]);
-                x[fr][n++][ZZ] = avg_z;
-
-                // Top edge
-                x[fr][n][XX] = j * espace + espace / 2;
-                x[fr][n][YY] = box[fr][1][1];
-                x[fr][n++][ZZ] = avg_z;
+            // the frames still in flight, in order
+#pragma omp taskwait
+            for(int fr = nread >= nbuf ? nread - nbuf + 1 : 0; fr < nread; ++fr) {
+                int slot = fr % nbuf;
+                store_frame_areas(areas, &cap, fr, slot_area + slot * areas->ngroups, 
+                    slot_area2D ? slot_area2D + slot * areas->ngroups : NULL, slot_box[slot]);
             }
+        }
+    }
+    gta_context_free(ctx);
+    sfree(group_start);
+    sfree(slot_area);
+    sfree(slot_area2D);
+    sfree(slot_box);
+    sfree(slot_dep);
+
+    print_log("Triangulated %d frames.\n", areas->nframes);
+    if(mesh)
+        close_mesh_writer(mesh);
+    if(vertex)
+        close_vertex_writer(vertex, areas->nframes);
+
+    for(int i = 0; i < nbuf; ++i) {
+        sfree(x[i]);
+    }
+    sfree(x);
+    sfree(box);
+    close_traj_stream(&stream);
+    restore_threads(caller_threads);
 
-            for(int j = 0; j < n_edge_y; ++j) {
-                // Left edge
-                x[fr][n][XX] = 0;
-                x[fr][n][YY] = j * espace + espace / 2;
-                
-                dist1 = x[fr][x_min_inds[j]][XX];
-                dist2 = box[fr][0][0] - x[fr][x_max_inds[j]][XX];
-                dist = dist1 + dist2;
-                avg_z = x[fr][x_min_inds[j]][ZZ] - (dist1/dist)*(x[fr][x_min_inds[j]][ZZ])
-                      + x[fr][x_max_inds[j]][ZZ] - (dist2/dist)*(x[fr][x_max_inds[j]][ZZ]);
-                x[fr][n++][ZZ] = avg_z;
-
-                // Right edge
-                x[fr][n][XX] = box[fr][0][0];
-                x[fr][n][YY] = j * espace + espace / 2;
-                x[fr][n++][ZZ] = avg_z;
-            }
+#ifdef GTA_BENCH
+    clock_t clocks = clock() - start;
+    print_log("Streaming triangulation took %d clocks, %f seconds.\n", 
+        clocks, (float)clocks/CLOCKS_PER_SEC);
+#endif
+}
 
-            sfree(y_min_inds);
-            sfree(y_max_inds);
-            sfree(x_min_inds);
-            sfree(x_max_inds);
 
-// #ifdef GTA_DEBUG
-//             FILE *f = fopen("points.txt", "w");
 
-//             for(int j = 0; j < n; ++j) {
-//                 fprintf(f, "%d: %f\t%f\t%f\n", j, x[fr][j][XX], x[fr][j][YY], x[fr][j][ZZ]);
-//             }
+void follow_tessellate_area(const char *traj_fname, 
+                            const char *ndx_fname, 
+                            int ngroups, 
+                            output_env_t *oenv, 
+                            int skip, 
+                            const struct gta_options *opt, 
+                            double wait, 
+                            const char *out_fname, 
+                            const char *mesh_fname, 
+                            const char *vertex_fname, 
+                            struct tri_area *areas) {
+    struct traj_stream stream;
+    rvec *x;
+    matrix box;
+    int cap = FRAMESTEP;
+
+    if(wait > 0)
+        print_log("Following %s until no new frame is written for %g seconds...\n", traj_fname, wait);
+    else
+        print_log("Following %s until interrupted...\n", traj_fname);
+    follow_traj_stream(traj_fname, ndx_fname, ngroups, oenv, skip, wait, &stream);
+    areas->natoms = stream.natoms;
+    areas->ngroups = stream.ngroups;
+    areas->nframes = 0;
+    snew(areas->group_natoms, stream.ngroups);
+    memcpy(areas->group_natoms, stream.isize, stream.ngroups * sizeof(int));
+
+    // offset of each group in the frames
+    int *group_start;
+    snew(group_start, areas->ngroups);
+    for(int g = 1; g < areas->ngroups; ++g) {
+        group_start[g] = group_start[g-1] + areas->group_natoms[g-1];
+    }
 
-//             fclose(f);
+    int caller_threads = init_threads(opt->nthreads);
+    unsigned char flags = opt->flags;
 
-//             print_log("Points saved to points.txt for debugging.\n");
-//             exit(0);
-// #endif
+    struct gta_context *ctx = gta_context_new(opt);
+    int nthreads = context_threads(ctx);
+    int nteam = nthreads < areas->ngroups ? nthreads : areas->ngroups;
+#ifndef _OPENMP
+    (void)nteam;
+#endif
 
-            // Calculate area including added edge and corner points
-            real *a2D = NULL;
-            if(flags & GTA_2D)  a2D = &(areas->area2D[fr]);
-            delaunay_surface_area(x[fr], box[fr], n, flags, a2D, &(areas->area[fr]));
+    snew(areas->area, cap * areas->ngroups);
+    snew(areas->area2Dbox, cap);
+    areas->area2D = NULL;
+    if(flags & GTA_2D)  snew(areas->area2D, cap * areas->ngroups);
+
+    snew(x, stream.natoms);
+    struct gta_mesh_writer *mesh = mesh_fname ? open_mesh_writer(mesh_fname, 1) : NULL;
+    struct gta_vertex_writer *vertex = vertex_fname 
+        ? open_vertex_writer(vertex_fname, areas->natoms, areas->ngroups, areas->group_natoms) : NULL;
+
+    FILE *out = fopen(out_fname, "w");
+    print_areas_header(out, areas);
+    fflush(out);
+
+    while(TRUE) {
+        double start = gta_tic();
+        gmx_bool more = read_traj_stream(&stream, x, box);
+        gta_toc(GTA_T_READ, start);
+        if(!more)
+            break;
+
+        int fr = areas->nframes++;
+        if(fr >= cap) {
+            cap += FRAMESTEP;
+            srenew(areas->area, cap * areas->ngroups);
+            srenew(areas->area2Dbox, cap);
+            if(flags & GTA_2D)  srenew(areas->area2D, cap * areas->ngroups);
         }
+
+        // A single group runs on the calling thread, so that dtriangulate_ws can split large frames between the threads
+#pragma omp parallel for num_threads(nteam) schedule(dynamic, 1) if(nteam > 1)
+        for(int g = 0; g < areas->ngroups; ++g) {
+            int i = fr * areas->ngroups + g;
+            struct gta_workspace *ws = context_ws(ctx);
+            ws->mesh = mesh;
+            ws->vertex = vertex;
+            tessellate_frame(x + group_start[g], box, areas->group_natoms[g], opt->espace, flags, fr, g, ws, 
+                g == 0 ? &(areas->area2Dbox[fr]) : NULL, areas->area2D ? &(areas->area2D[i]) : NULL, &(areas->area[i]));
+        }
+
+        start = gta_tic();
+        print_areas_row(out, areas, fr);
+        fflush(out);
+        gta_toc(GTA_T_OUTPUT, start);
+    }
+
+    fclose(out);
+    print_log("Triangulated %d frames. Surface areas saved to %s\n", areas->nframes, out_fname);
+
+    gta_context_free(ctx);
+    sfree(group_start);
+    if(mesh)
+        close_mesh_writer(mesh);
+    if(vertex)
+        close_vertex_writer(vertex, areas->nframes);
+    sfree(x);
+    close_traj_stream(&stream);
+    restore_threads(caller_threads);
+}
+
+void delaunay_tessellate(rvec **x, 
+                         matrix *box, 
+                         const struct gta_options *opt, 
+                         const char *mesh_fname, 
+                         const char *vertex_fname, 
+                         struct tri_area *areas) {
+#ifdef GTA_BENCH
+    clock_t start = clock();
+#endif
+
+    int caller_threads = init_threads(opt->nthreads);
+    unsigned char flags = opt->flags;
+
+    int ngroups = areas->ngroups > 1 ? areas->ngroups : 1;
+    int *group_natoms, *group_start;
+    snew(group_natoms, ngroups);
+    snew(group_start, ngroups);
+    group_natoms[0] = areas->natoms;
+    for(int g = 0; g < ngroups && areas->group_natoms; ++g) {
+        group_natoms[g] = areas->group_natoms[g];
+        group_start[g] = g > 0 ? group_start[g-1] + group_natoms[g-1] : 0;
     }
-    else { // triangulate without correction for periodic bounds
+
+    // Calculate triangulated surface area for every frame
+    struct gta_context *ctx = gta_context_new(opt);
+    int nthreads = context_threads(ctx);
+    struct gta_stats *tstats = NULL; // [nthreads] statistics of the frames of each thread
+    if(areas->stats) {
+        gta_stats_groups(areas->stats, ngroups, group_natoms, flags & GTA_2D);
+        snew(tstats, nthreads);
+    }
+    else {
+        snew(areas->area, areas->nframes * ngroups);
+        snew(areas->area2Dbox, areas->nframes);
+        if(flags & GTA_2D)  snew(areas->area2D, areas->nframes * ngroups);
+    }
+
+    if(flags & GTA_CORRECT) // add correction for periodic bounds
+        print_log("Triangulating and correcting %d frames...\n", areas->nframes);
+    else
         print_log("Triangulating %d frames...\n", areas->nframes);
 
-#pragma omp parallel for shared(areas,x,flags)
-        for(int fr = 0; fr < areas->nframes; ++fr) {
+    struct gta_mesh_writer *mesh = mesh_fname ? open_mesh_writer(mesh_fname, 0) : NULL;
+    struct gta_vertex_writer *vertex = vertex_fname 
+        ? open_vertex_writer(vertex_fname, areas->natoms, ngroups, group_natoms) : NULL;
+
+#ifdef _OPENMP
+    // schedule(runtime) reads the schedule of the calling thread, which belongs to the caller
+    omp_sched_t caller_kind;
+    int caller_chunk;
+    omp_get_schedule(&caller_kind, &caller_chunk);
+#endif
+    if(areas->stats) { // one contiguous block of frames per thread, in the order of the thread numbers
+        struct gta_options sopt = *opt;
+        sopt.schedule = GTA_SCHED_STATIC;
+        sopt.chunk = 0;
+        set_schedule(&sopt);
+    }
+    else {
+        set_schedule(opt);
+    }
+
+#pragma omp parallel num_threads(nthreads) shared(areas,x,flags,ctx,mesh,vertex,group_natoms,group_start,tstats)
+    {
+        struct gta_workspace *ws = context_ws(ctx); // reused for all frames of this thread
+        ws->mesh = mesh;
+        ws->vertex = vertex;
+        struct gta_stats *ts = NULL;
+        if(areas->stats) {
+            ts = &tstats[thread_num()];
+            gta_stats_clone(ts, areas->stats);
+        }
+
 #if defined _OPENMP && defined GTA_DEBUG
-            print_log("%d threads triangulating.\n", omp_get_num_threads());
+#pragma omp single nowait
+        print_log("%d threads triangulating.\n", omp_get_num_threads());
 #endif
-            
-            // BOX PRINT
-            // if(fr == 0) {
-            //     printf("%f\t%f\t%f\n%f\t%f\t%f\n%f\t%f\t%f\n",
-            //         box[fr][0][0], box[fr][0][1], box[fr][0][2], 
-            //         box[fr][1][0], box[fr][1][1], box[fr][1][2],
-            //         box[fr][2][0], box[fr][2][1], box[fr][2][2]);
-            // }
-
-            // 2D area of box
-            areas->area2Dbox[fr] = box[fr][0][0] * box[fr][1][1];
 
+        // The work items are all frames of the first group, then all frames of the second group, and so on.
+        // The default static schedule gives each thread a contiguous block of frames of the same group, 
+        // which keeps its previous triangulation close to the next frame for GTA_INCREMENTAL
+#pragma omp for schedule(runtime)
+        for(int item = 0; item < areas->nframes * ngroups; ++item) {
+            int g = item / areas->nframes, fr = item % areas->nframes;
+            if(ts) {
+                real a2Dbox, a2D = 0, a3D;
+                tessellate_frame(x[fr] + group_start[g], box[fr], group_natoms[g], opt->espace, flags, fr, g, ws, 
+                    g == 0 ? &a2Dbox : NULL, (flags & GTA_2D) ? &a2D : NULL, &a3D);
+                gta_stats_add(ts, g, a3D, a2D);
+                if(g == 0)  gta_stats_add_box(ts, a2Dbox);
+                continue;
+            }
+
+            int i = fr * ngroups + g;
             real *a2D = NULL;
-            if(flags & GTA_2D)  a2D = &(areas->area2D[fr]);
-            delaunay_surface_area(x[fr], box[fr], areas->natoms, flags, a2D, &(areas->area[fr]));
+            if(flags & GTA_2D)  a2D = &(areas->area2D[i]);
+            tessellate_frame(x[fr] + group_start[g], box[fr], group_natoms[g], opt->espace, flags, fr, g, ws, 
+                g == 0 ? &(areas->area2Dbox[fr]) : NULL, a2D, &(areas->area[i]));
+        }
+    }
+
+    if(areas->stats) {
+        for(int t = 0; t < nthreads; ++t) {
+            if(tstats[t].ngroups > 0) { // threads that were not started have no statistics
+                gta_stats_merge(areas->stats, &tstats[t]);
+                gta_stats_free(&tstats[t]);
+            }
         }
+        sfree(tstats);
     }
 
+    gta_context_free(ctx);
+    sfree(group_natoms);
+    sfree(group_start);
+
+    if(mesh)
+        close_mesh_writer(mesh);
+    if(vertex)
+        close_vertex_writer(vertex, areas->nframes);
+
+#ifdef _OPENMP
+    omp_set_schedule(caller_kind, caller_chunk);
+#endif
+    restore_threads(caller_threads);
+
 #ifdef GTA_BENCH
     clock_t clocks = clock() - start;
     print_log("Triangulation took %d clocks, %f seconds.\n", 
@@ -329,87 +628,507 @@ void delaunay_tessellate(rvec **x,
 }
 
 
+static int init_threads(int nthreads) {
+#ifdef _OPENMP
+    int caller_threads = omp_get_max_threads();
+    if(nthreads > 0)
+        omp_set_num_threads(nthreads);
+    if(nthreads > 1 || nthreads <= 0)
+        print_log("Triangulation will be parallelized.\n");
+    return caller_threads;
+#else
+    (void)nthreads;
+    return 1;
+#endif
+}
+
+static void restore_threads(int caller_threads) {
+#ifdef _OPENMP
+    omp_set_num_threads(caller_threads);
+#else
+    (void)caller_threads;
+#endif
+}
+
+
+static struct gta_workspace *gta_ws_new() {
+    struct gta_workspace *ws;
+    snew(ws, 1);
+    ws->dt = dtws_new();
+    return ws;
+}
+
+static void gta_ws_free(struct gta_workspace *ws) {
+    dtws_free(ws->dt);
+    sfree(ws->edge);
+    sfree(ws->bounds);
+    sfree(ws->bound_inds);
+    sfree(ws->x);
+    sfree(ws->vert);
+    sfree(ws->fvert);
+    sfree(ws);
+}
+
+
+static int context_threads(struct gta_context *ctx) {
+#ifdef _OPENMP
+    int nthreads = ctx->opt.nthreads > 0 ? ctx->opt.nthreads : omp_get_max_threads();
+#else
+    int nthreads = 1;
+#endif
+    if(nthreads > ctx->nws) {
+        srenew(ctx->ws, nthreads);
+        memset(ctx->ws + ctx->nws, 0, (nthreads - ctx->nws) * sizeof(struct gta_workspace*));
+        ctx->nws = nthreads;
+    }
+    return nthreads;
+}
+
+static void set_schedule(const struct gta_options *opt) {
+#ifdef _OPENMP
+    omp_set_schedule(opt->schedule == GTA_SCHED_DYNAMIC ? omp_sched_dynamic 
+                   : opt->schedule == GTA_SCHED_GUIDED ? omp_sched_guided : omp_sched_static, 
+                   opt->chunk > 0 ? opt->chunk : 0);
+#else
+    (void)opt;
+#endif
+}
+
+static const rvec *frame_coords(struct gta_workspace *ws, const float *xyz, int natoms, size_t stride) {
+    if(sizeof(real) == sizeof(float) && stride == DIM)
+        return (const rvec*)xyz;
+
+    if(natoms > ws->x_cap) {
+        ws->x_cap = natoms;
+        srenew(ws->x, ws->x_cap);
+    }
+    for(int i = 0; i < natoms; ++i) {
+        ws->x[i][XX] = xyz[i * stride];
+        ws->x[i][YY] = xyz[i * stride + 1];
+        ws->x[i][ZZ] = xyz[i * stride + 2];
+    }
+    return (const rvec*)ws->x;
+}
+
+
+static void tessellate_frame(const rvec *x, 
+                             matrix box, 
+                             int natoms, 
+                             real espace, 
+                             unsigned char flags, 
+                             int frame, 
+                             int group, 
+                             struct gta_workspace *ws, 
+                             real *a2Dbox, 
+                             real *a2D, 
+                             real *a3D) {
+    double frame_start = gta_tic();
+
+    // 2D area of box
+    if(a2Dbox)  *a2Dbox = box[0][0] * box[1][1];
+
+    int nedge = 0;
+    if(flags & GTA_CORRECT) { // add correction for periodic bounds
+        double start = gta_tic();
+        nedge = add_edge_points(x, box, natoms, espace, ws);
+        gta_toc(GTA_T_EDGE, start);
+    }
+
+    double *vert = NULL;
+    if(ws->vertex) {
+        if(natoms > ws->vert_cap) {
+            ws->vert_cap = natoms;
+            srenew(ws->vert, natoms);
+            srenew(ws->fvert, natoms);
+        }
+        vert = ws->vert;
+        memset(vert, 0, natoms * sizeof(double));
+    }
+
+    surface_area(x, natoms, ws->edge, nedge, flags, frame, group, ws->mesh, a2D, a3D, vert, ws->dt);
+
+    if(vert) {
+        double start = gta_tic();
+        for(int i = 0; i < natoms; ++i)  ws->fvert[i] = vert[i];
+        write_vertex_areas(ws->vertex, frame, group, ws->fvert);
+        gta_toc(GTA_T_OUTPUT, start);
+    }
+
+    gta_toc(GTA_T_FRAME, frame_start);
+    gta_count(GTA_C_FRAMES, 1);
+}
+
+
+static int add_edge_points(const rvec *x, 
+                           matrix box, 
+                           int natoms, 
+                           real espace, 
+                           struct gta_workspace *ws) {
+    // Calculate number of edge points
+    int n_edge_x = box[0][0] / espace;
+    int n_edge_y = box[1][1] / espace;
+    int nedge = 4 + 2 * n_edge_x + 2 * n_edge_y;
+
+    // z-coordinates of particles closest to box corners
+    real bot_left = FLT_MAX, top_right = -FLT_MAX, 
+        top_left = FLT_MAX, bot_right = -FLT_MAX, 
+        avg_z;
+    int bot_left_ind = 0, top_right_ind = 0, top_left_ind = 0, bot_right_ind = 0;
+
+    // Min max coordinates for each interval, kept in the workspace between frames
+    int nbounds = 2 * (n_edge_x + 1) + 2 * (n_edge_y + 1);
+    if(nbounds > ws->bounds_cap) {
+        srenew(ws->bounds, nbounds);
+        srenew(ws->bound_inds, nbounds);
+        ws->bounds_cap = nbounds;
+    }
+    if(nedge > ws->edge_cap) {
+        srenew(ws->edge, nedge);
+        ws->edge_cap = nedge;
+    }
+
+    real *y_mins = ws->bounds, *y_maxes = y_mins + n_edge_x + 1, 
+        *x_mins = y_maxes + n_edge_x + 1, *x_maxes = x_mins + n_edge_y + 1;
+    int *y_min_inds = ws->bound_inds, *y_max_inds = y_min_inds + n_edge_x + 1, 
+        *x_min_inds = y_max_inds + n_edge_x + 1, *x_max_inds = x_min_inds + n_edge_y + 1;
+
+    for(int i = 0; i <= n_edge_x; ++i) {
+        y_mins[i] = FLT_MAX;
+        y_maxes[i] = -FLT_MAX;
+    }
+    for(int i = 0; i <= n_edge_y; ++i) {
+        x_mins[i] = FLT_MAX;
+        x_maxes[i] = -FLT_MAX;
+    }
+
+    memset(ws->bound_inds, 0, sizeof(int) * nbounds);
+
+    // Find the corner and interval extremes in one pass over the atoms
+    for(int j = 0; j < natoms; ++j) {
+        real xj = x[j][XX], yj = x[j][YY];
+
+        // min and max distance from origin
+        real dist = xj * xj + yj * yj;
+        if(dist < bot_left) {
+            bot_left = dist;
+            bot_left_ind = j;
+        }
+        if(dist > top_right) {
+            top_right = dist;
+            top_right_ind = j;
+        }
+
+        // min and max distance from top left corner
+        real dY = box[1][1] - yj;
+        dist = xj * xj + dY * dY;
+        if(dist < top_left) {
+            top_left = dist;
+            top_left_ind = j;
+        }
+        if(dist > bot_right) {
+            bot_right = dist;
+            bot_right_ind = j;
+        }
+
+        // Check min max y in x interval
+        int x_interval = edge_interval(xj, box[0][0], n_edge_x);
+
+        if(yj < y_mins[x_interval]) {
+            y_mins[x_interval] = yj;
+            y_min_inds[x_interval] = j;
+        }
+
+        if(yj > y_maxes[x_interval]) {
+            y_maxes[x_interval] = yj;
+            y_max_inds[x_interval] = j;
+        }
+
+        // Check min max x in y interval
+        int y_interval = edge_interval(yj, box[1][1], n_edge_y);
+        
+        if(xj < x_mins[y_interval]) {
+            x_mins[y_interval] = xj;
+            x_min_inds[y_interval] = j;
+        }
+
+        if(xj > x_maxes[y_interval]) {
+            x_maxes[y_interval] = xj;
+            x_max_inds[y_interval] = j;
+        }
+    }
+
+    avg_z = ( x[bot_left_ind][ZZ] 
+            + x[top_right_ind][ZZ] 
+            + x[top_left_ind][ZZ] 
+            + x[bot_right_ind][ZZ]) / 4.0;
+
+    // add edge and corner points
+    rvec *xf = ws->edge;
+    int n = 0;
+
+    // Add corner points
+    xf[n][XX]    = 0;
+    xf[n][YY]    = 0;
+    xf[n++][ZZ]  = avg_z;
+
+    xf[n][XX]    = box[0][0];
+    xf[n][YY]    = 0;
+    xf[n++][ZZ]  = avg_z;
+
+    xf[n][XX]    = box[0][0];
+    xf[n][YY]    = box[1][1];
+    xf[n++][ZZ]  = avg_z;
+
+    xf[n][XX]    = 0;
+    xf[n][YY]    = box[1][1];
+    xf[n++][ZZ]  = avg_z;
+
+    // Add edge points
+    real dist, dist1, dist2;
+    for(int j = 0; j < n_edge_x; ++j) {
+        // Bottom edge
+        xf[n][XX] = j * espace + espace / 2; // Go to middle of interval
+        xf[n][YY] = 0;
+        // edge Z coord is distance-from-edge-weighted average between the Zs of the two points closest to the two edges of this axis
+        dist1 = x[y_min_inds[j]][YY];
+        dist2 = box[1][1] - x[y_max_inds[j]][YY];
+        dist = dist1 + dist2;
+        avg_z = x[y_min_inds[j]][ZZ] - (dist1/dist)*(x[y_min_inds[j]][ZZ]) 
+              + x[y_max_inds[j]][ZZ] - (dist2/dist)*(x[y_max_inds[j]][ZZ]);
+        xf[n++][ZZ] = avg_z;
+
+        // Top edge
+        xf[n][XX] = j * espace + espace / 2;
+        xf[n][YY] = box[1][1];
+        xf[n++][ZZ] = avg_z;
+    }
+
+    for(int j = 0; j < n_edge_y; ++j) {
+        // Left edge
+        xf[n][XX] = 0;
+        xf[n][YY] = j * espace + espace / 2;
+        
+        dist1 = x[x_min_inds[j]][XX];
+        dist2 = box[0][0] - x[x_max_inds[j]][XX];
+        dist = dist1 + dist2;
+        avg_z = x[x_min_inds[j]][ZZ] - (dist1/dist)*(x[x_min_inds[j]][ZZ])
+              + x[x_max_inds[j]][ZZ] - (dist2/dist)*(x[x_max_inds[j]][ZZ]);
+        xf[n++][ZZ] = avg_z;
+
+        // Right edge
+        xf[n][XX] = box[0][0];
+        xf[n][YY] = j * espace + espace / 2;
+        xf[n++][ZZ] = avg_z;
+    }
+
+    return n;
+}
+
+
 void delaunay_surface_area(const rvec *x,
                            matrix box, 
                            int natoms, 
                            unsigned char flags,
+                           int frame, 
                            real *a2D,
                            real *a3D) {
-    static int iter = 0;
+    struct dtWorkspace *ws = dtws_new();
+    delaunay_surface_area_ws(x, box, natoms, flags, frame, a2D, a3D, ws);
+    dtws_free(ws);
+}
+
+
+void delaunay_surface_area_ws(const rvec *x,
+                              matrix box, 
+                              int natoms, 
+                              unsigned char flags,
+                              int frame, 
+                              real *a2D,
+                              real *a3D, 
+                              struct dtWorkspace *ws) {
+    (void)box; // not needed without edge correction points, kept for the callers of delaunay_surface_area
+    surface_area(x, natoms, NULL, 0, flags, frame, 0, NULL, a2D, a3D, NULL, ws);
+}
 
+
+static void surface_area(const rvec *x, 
+                         int natoms, 
+                         const rvec *edge, 
+                         int nedge, 
+                         unsigned char flags, 
+                         int frame, 
+                         int group, 
+                         struct gta_mesh_writer *mesh, 
+                         real *a2D, 
+                         real *a3D, 
+                         double *vert, 
+                         struct dtWorkspace *ws) {
     struct dTriangulation tri;
-    ++iter;
 
-    // Input initialization
-    snew(tri.points, 2 * natoms);
-    tri.npoints = natoms;
+    // Input initialization, edge points follow the atoms
+    tri.npoints = natoms + nedge;
+    if(sizeof(real) == sizeof(float)) {
+        // triangulate the x and y of the rvecs in place instead of widening them into a copy
+        tri.points = NULL;
+        tri.fpoints = (const float*)x;
+        tri.nfpoints = natoms;
+        tri.fpoints2 = (const float*)edge;
+        tri.fstride = DIM;
+    }
+    else {
+        tri.points = dtws_points(ws, tri.npoints);
 
-    for(int i = 0; i < natoms; ++i) {
-        tri.points[2*i] = x[i][XX];
-        tri.points[2*i+1] = x[i][YY];
+        for(int i = 0; i < natoms; ++i) {
+            tri.points[2*i] = x[i][XX];
+            tri.points[2*i+1] = x[i][YY];
+        }
+        for(int i = 0; i < nedge; ++i) {
+            tri.points[2*(natoms+i)] = edge[i][XX];
+            tri.points[2*(natoms+i)+1] = edge[i][YY];
+        }
     }
 
-    // triangulate
-    dtriangulate(&tri);
+    // triangulate, only repairing with the edge correction points, which keep the convex hull fixed to the box
+    if((flags & GTA_INCREMENTAL) && (flags & GTA_CORRECT))
+        dtriangulate_inc_ws(&tri, ws);
+    else
+        dtriangulate_ws(&tri, ws);
 
+    double start = gta_tic();
     if(flags & GTA_PRINT) { // print triangle data to files that can be viewed with triangle's 'showme' program
-        char fname1[50], fname2[50];
-        sprintf(fname1, "triangles%d.node", iter);
-        sprintf(fname2, "triangles%d.ele", iter);
+        char fname1[64], fname2[64];
+        if(group > 0) {
+            sprintf(fname1, "triangles%d_%d.node", frame, group);
+            sprintf(fname2, "triangles%d_%d.ele", frame, group);
+        }
+        else {
+            sprintf(fname1, "triangles%d.node", frame);
+            sprintf(fname2, "triangles%d.ele", frame);
+        }
         print_dtrifiles(&tri, fname1, fname2);
     }
 
-    // TODO: Add flag check!
-    // print_triangulation3D(x, box, &tri, iter - 1, "tri3D.pdb");
-
-    sfree(tri.points);
+    if(mesh)
+        write_mesh(mesh, frame, group, &tri);
+    gta_toc(GTA_T_OUTPUT, start);
 
     // calculate surface area of triangles
-    if(a2D) {
-        if(a3D) {
-            *a2D = 0;
-            *a3D = 0;
-            rvec a, b, c;
-            for(int i = 0; i < tri.ntriangles; ++i) {
-                copy_rvec(x[tri.triangles[3*i]], a);
-                copy_rvec(x[tri.triangles[3*i + 1]], b);
-                copy_rvec(x[tri.triangles[3*i + 2]], c);
-
-                (*a3D) += area_tri(a, b, c);
-
-                a[ZZ] = 0;
-                b[ZZ] = 0;
-                c[ZZ] = 0;
-
-                (*a2D) += area_tri(a, b, c);
-            }
+    start = gta_tic();
+    sum_tri_areas(x, natoms, edge, &tri, a2D, a3D, vert);
+    gta_toc(GTA_T_AREA, start);
+}
+
+
+// The triangles are processed in blocks of AREABLOCK: 
+// their edge vectors are gathered into small structure-of-arrays buffers on the stack, 
+// which area_block can then work through with full SIMD vectors.
+// Both areas come from the same cross product, the 2D area being just its z-component. 
+// The sums are kept in double, since summing millions of small areas in single precision drifts.
+// The areas of the atoms are scattered from the per-triangle areas of each block, so the cross products stay vectorized.
+static void sum_tri_areas(const rvec *x, 
+                          int natoms, 
+                          const rvec *edge, 
+                          const struct dTriangulation *tri, 
+                          real *a2D, 
+                          real *a3D, 
+                          double *vert) {
+    double e[6 * AREABLOCK];
+    double t3D[AREABLOCK];
+    double sum2D = 0, sum3D = 0;
+
+    for(int t0 = 0; t0 < tri->ntriangles; t0 += AREABLOCK) {
+        int nt = tri->ntriangles - t0 < AREABLOCK ? tri->ntriangles - t0 : AREABLOCK;
+        const int *tris = tri->triangles + 3 * t0;
+
+        for(int i = 0; i < nt; ++i) {
+            const real *a = tris[3*i] < natoms ? x[tris[3*i]] : edge[tris[3*i] - natoms];
+            const real *b = tris[3*i + 1] < natoms ? x[tris[3*i + 1]] : edge[tris[3*i + 1] - natoms];
+            const real *c = tris[3*i + 2] < natoms ? x[tris[3*i + 2]] : edge[tris[3*i + 2] - natoms];
+            e[i]                 = (double)b[XX] - a[XX];
+            e[AREABLOCK + i]     = (double)b[YY] - a[YY];
+            e[2 * AREABLOCK + i] = (double)b[ZZ] - a[ZZ];
+            e[3 * AREABLOCK + i] = (double)c[XX] - a[XX];
+            e[4 * AREABLOCK + i] = (double)c[YY] - a[YY];
+            e[5 * AREABLOCK + i] = (double)c[ZZ] - a[ZZ];
         }
-        else {
-            *a2D = 0;
-            rvec a, b, c;
-            for(int i = 0; i < tri.ntriangles; ++i) {
-                copy_rvec(x[tri.triangles[3*i]], a);
-                copy_rvec(x[tri.triangles[3*i + 1]], b);
-                copy_rvec(x[tri.triangles[3*i + 2]], c);
-
-                a[ZZ] = 0;
-                b[ZZ] = 0;
-                c[ZZ] = 0;
-
-                (*a2D) += area_tri(a, b, c);
+        // pad the last block with empty triangles
+        for(int d = 0; nt < AREABLOCK && d < 6; ++d)
+            memset(e + d * AREABLOCK + nt, 0, (AREABLOCK - nt) * sizeof(double));
+
+        area_block(e, &sum2D, &sum3D, vert ? t3D : NULL);
+
+        for(int i = 0; vert && i < nt; ++i) {
+            const int *t = tris + 3 * i;
+            int n = (t[0] < natoms) + (t[1] < natoms) + (t[2] < natoms);
+            if(n == 0) // only edge correction points
+                continue;
+            double share = t3D[i] / (2.0 * n);
+            for(int k = 0; k < 3; ++k) {
+                if(t[k] < natoms)  vert[t[k]] += share;
             }
         }
     }
-    else if(a3D) {
-        *a3D = 0;
-        for(int i = 0; i < tri.ntriangles; ++i) {
-            (*a3D) += area_tri( x[tri.triangles[3*i]], 
-                                x[tri.triangles[3*i + 1]], 
-                                x[tri.triangles[3*i + 2]]);
-        }
-    }
 
-    free(tri.triangles);
+    if(a2D)     *a2D = sum2D / 2.0;
+    if(a3D)     *a3D = sum3D / 2.0;
+}
+
+static void area_block(const double *e, double *a2D, double *a3D, double *t3D) {
+    const double *abx = e, *aby = e + AREABLOCK, *abz = e + 2 * AREABLOCK, 
+        *acx = e + 3 * AREABLOCK, *acy = e + 4 * AREABLOCK, *acz = e + 5 * AREABLOCK;
+
+#if defined __AVX512F__
+    __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    for(int i = 0; i < AREABLOCK; i += 8) {
+        __m512d bx = _mm512_loadu_pd(abx + i), by = _mm512_loadu_pd(aby + i), bz = _mm512_loadu_pd(abz + i);
+        __m512d cx = _mm512_loadu_pd(acx + i), cy = _mm512_loadu_pd(acy + i), cz = _mm512_loadu_pd(acz + i);
+        __m512d px = _mm512_sub_pd(_mm512_mul_pd(by, cz), _mm512_mul_pd(bz, cy));
+        __m512d py = _mm512_sub_pd(_mm512_mul_pd(bz, cx), _mm512_mul_pd(bx, cz));
+        __m512d pz = _mm512_sub_pd(_mm512_mul_pd(bx, cy), _mm512_mul_pd(by, cx));
+        __m512d n2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(px, px), _mm512_mul_pd(py, py)), 
+                                   _mm512_mul_pd(pz, pz));
+        __m512d a = _mm512_sqrt_pd(n2);
+        if(t3D)  _mm512_storeu_pd(t3D + i, a);
+        s3 = _mm512_add_pd(s3, a);
+        s2 = _mm512_add_pd(s2, _mm512_abs_pd(pz));
+    }
+    *a2D += _mm512_reduce_add_pd(s2);
+    *a3D += _mm512_reduce_add_pd(s3);
+#elif defined __AVX__
+    const __m256d signmask = _mm256_set1_pd(-0.0);
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    for(int i = 0; i < AREABLOCK; i += 4) {
+        __m256d bx = _mm256_loadu_pd(abx + i), by = _mm256_loadu_pd(aby + i), bz = _mm256_loadu_pd(abz + i);
+        __m256d cx = _mm256_loadu_pd(acx + i), cy = _mm256_loadu_pd(acy + i), cz = _mm256_loadu_pd(acz + i);
+        __m256d px = _mm256_sub_pd(_mm256_mul_pd(by, cz), _mm256_mul_pd(bz, cy));
+        __m256d py = _mm256_sub_pd(_mm256_mul_pd(bz, cx), _mm256_mul_pd(bx, cz));
+        __m256d pz = _mm256_sub_pd(_mm256_mul_pd(bx, cy), _mm256_mul_pd(by, cx));
+        __m256d n2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(px, px), _mm256_mul_pd(py, py)), 
+                                   _mm256_mul_pd(pz, pz));
+        __m256d a = _mm256_sqrt_pd(n2);
+        if(t3D)  _mm256_storeu_pd(t3D + i, a);
+        s3 = _mm256_add_pd(s3, a);
+        s2 = _mm256_add_pd(s2, _mm256_andnot_pd(signmask, pz));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, s2);
+    *a2D += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, s3);
+    *a3D += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    double s2 = 0, s3 = 0;
+    for(int i = 0; i < AREABLOCK; ++i) {
+        double px = aby[i] * acz[i] - abz[i] * acy[i];
+        double py = abz[i] * acx[i] - abx[i] * acz[i];
+        double pz = abx[i] * acy[i] - aby[i] * acx[i];
+        double a = sqrt(px * px + py * py + pz * pz);
+        if(t3D)  t3D[i] = a;
+        s3 += a;
+        s2 += fabs(pz);
+    }
+    *a2D += s2;
+    *a3D += s3;
+#endif
 }
 
 
@@ -446,24 +1165,20 @@ void print_triangulation3D(const rvec *x,
 }
 
 void print_areas(const char *fname, const struct tri_area *areas) {
-    FILE *f = fopen(fname, "w");
-    real sum = 0;
-
-    if(areas->area2D) {
-        fprintf(f, "# FRAME\tAREA\t2DAREA\tBOX-AREA\t\"\"/PARTICLE\n");
-        for(int i = 0; i < areas->nframes; ++i) {
-            fprintf(f, "%d\t%f\t%f\t%f\t%f\t%f\t%f\n", i, areas->area[i], areas->area2D[i], areas->area2Dbox[i], 
-                areas->area[i] / areas->natoms, areas->area2D[i] / areas->natoms, areas->area2Dbox[i] / areas->natoms);
-            sum += areas->area[i];
-        }
+    if(areas->ngroups > 1) {
+        print_group_areas(fname, areas);
+        return;
     }
-    else {
-        fprintf(f, "# FRAME\tAREA\tBOX-AREA\t\"\"/PARTICLE\n");
-        for(int i = 0; i < areas->nframes; ++i) {
-            fprintf(f, "%d\t%f\t%f\t%f\t%f\n", i, areas->area[i], areas->area2Dbox[i], 
-                areas->area[i] / areas->natoms, areas->area2Dbox[i] / areas->natoms);
-            sum += areas->area[i];
-        }
+
+    FILE *f = fopen(fname, "w");
+    double sum = 0;
+
+    setvbuf(f, NULL, _IOFBF, PRINTBUF);
+
+    print_areas_header(f, areas);
+    for(int i = 0; i < areas->nframes; ++i) {
+        print_areas_row(f, areas, i);
+        sum += areas->area[i];
     }
     print_log("Average surface area: %f\n", sum / areas->nframes);
     print_log("Average area per particle: %f\n", (sum / areas->nframes) / areas->natoms);
@@ -472,6 +1187,97 @@ void print_areas(const char *fname, const struct tri_area *areas) {
     print_log("Surface areas saved to %s\n", fname);
 }
 
+static void store_frame_areas(struct tri_area *areas, int *cap, int fr, const real *area, const real *area2D, real area2Dbox) {
+    int ngroups = areas->ngroups;
+    areas->nframes = fr + 1;
+    if(areas->stats) {
+        for(int g = 0; g < ngroups; ++g)
+            gta_stats_add(areas->stats, g, area[g], area2D ? area2D[g] : 0);
+        gta_stats_add_box(areas->stats, area2Dbox);
+        return;
+    }
+
+    if(fr >= *cap) {
+        *cap += FRAMESTEP;
+        srenew(areas->area, *cap * ngroups);
+        srenew(areas->area2Dbox, *cap);
+        if(area2D)  srenew(areas->area2D, *cap * ngroups);
+    }
+    memcpy(areas->area + fr * ngroups, area, ngroups * sizeof(real));
+    if(area2D)  memcpy(areas->area2D + fr * ngroups, area2D, ngroups * sizeof(real));
+    areas->area2Dbox[fr] = area2Dbox;
+}
+
+// Same columns as print_areas, repeated for each group. The box area is the same for all groups.
+static void print_group_areas(const char *fname, const struct tri_area *areas) {
+    int ngroups = areas->ngroups;
+    FILE *f = fopen(fname, "w");
+    double *sum;
+    snew(sum, ngroups);
+
+    setvbuf(f, NULL, _IOFBF, PRINTBUF);
+
+    print_areas_header(f, areas);
+    for(int fr = 0; fr < areas->nframes; ++fr) {
+        print_areas_row(f, areas, fr);
+        for(int g = 0; g < ngroups; ++g) {
+            sum[g] += areas->area[fr * ngroups + g];
+        }
+    }
+    for(int g = 0; g < ngroups; ++g) {
+        print_log("Average surface area of group %d: %f\n", g, sum[g] / areas->nframes);
+        print_log("Average area per particle of group %d: %f\n", g, (sum[g] / areas->nframes) / areas->group_natoms[g]);
+    }
+
+    fclose(f);
+    sfree(sum);
+    print_log("Surface areas saved to %s\n", fname);
+}
+
+static void print_areas_header(FILE *f, const struct tri_area *areas) {
+    if(areas->ngroups <= 1) {
+        if(areas->area2D)
+            fprintf(f, "# FRAME\tAREA\t2DAREA\tBOX-AREA\t\"\"/PARTICLE\n");
+        else
+            fprintf(f, "# FRAME\tAREA\tBOX-AREA\t\"\"/PARTICLE\n");
+        return;
+    }
+
+    fprintf(f, "# FRAME");
+    for(int g = 0; g < areas->ngroups; ++g) {
+        if(areas->area2D)
+            fprintf(f, "\tAREA[%d]\t2DAREA[%d]\tBOX-AREA\t\"\"/PARTICLE[%d]", g, g, g);
+        else
+            fprintf(f, "\tAREA[%d]\tBOX-AREA\t\"\"/PARTICLE[%d]", g, g);
+    }
+    fprintf(f, "\n");
+}
+
+static void print_areas_row(FILE *f, const struct tri_area *areas, int fr) {
+    if(areas->ngroups <= 1) {
+        int n = areas->natoms;
+        if(areas->area2D)
+            fprintf(f, "%d\t%f\t%f\t%f\t%f\t%f\t%f\n", fr, areas->area[fr], areas->area2D[fr], areas->area2Dbox[fr], 
+                areas->area[fr] / n, areas->area2D[fr] / n, areas->area2Dbox[fr] / n);
+        else
+            fprintf(f, "%d\t%f\t%f\t%f\t%f\n", fr, areas->area[fr], areas->area2Dbox[fr], 
+                areas->area[fr] / n, areas->area2Dbox[fr] / n);
+        return;
+    }
+
+    fprintf(f, "%d", fr);
+    for(int g = 0; g < areas->ngroups; ++g) {
+        int i = fr * areas->ngroups + g, n = areas->group_natoms[g];
+        if(areas->area2D)
+            fprintf(f, "\t%f\t%f\t%f\t%f\t%f\t%f", areas->area[i], areas->area2D[i], areas->area2Dbox[fr], 
+                areas->area[i] / n, areas->area2D[i] / n, areas->area2Dbox[fr] / n);
+        else
+            fprintf(f, "\t%f\t%f\t%f\t%f", areas->area[i], areas->area2Dbox[fr], 
+                areas->area[i] / n, areas->area2Dbox[fr] / n);
+    }
+    fprintf(f, "\n");
+}
+
 void print_dtrifiles(const struct dTriangulation *tri, 
                      const char *node_name, 
                      const char *ele_name) {
@@ -480,7 +1286,9 @@ void print_dtrifiles(const struct dTriangulation *tri,
 
     fprintf(node, "%d\t2\t0\t0\n", tri->npoints);
     for(int i = 0; i < tri->npoints; ++i) {
-        fprintf(node, "%d\t%f\t%f\n", i, tri->points[2*i], tri->points[2*i + 1]);
+        dtreal xy[2];
+        dtpoint(tri, i, xy);
+        fprintf(node, "%d\t%f\t%f\n", i, xy[0], xy[1]);
     }
 
     fclose(node);
@@ -497,8 +1305,259 @@ void print_dtrifiles(const struct dTriangulation *tri,
     fclose(ele);
 }
 
+// The header fields are written one by one so that the layout does not depend on struct padding.
+void print_areas_bin(const char *fname, const struct tri_area *areas, unsigned char flags) {
+    const char magic[8] = "GTAAREA";
+    uint32_t ngroups = areas->ngroups > 1 ? areas->ngroups : 1;
+    char (*names)[16];
+    const real **cols; // first value of each column, read with a stride of ngroups except for area2Dbox
+    uint32_t ncols = 0;
+
+    snew(names, 2 * ngroups + 1);
+    snew(cols, 2 * ngroups + 1);
+    for(uint32_t g = 0; g < ngroups; ++g) {
+        if(ngroups > 1)     sprintf(names[ncols], "area.%u", g);
+        else                strcpy(names[ncols], "area");
+        cols[ncols++] = areas->area + g;
+        if(areas->area2D) {
+            if(ngroups > 1)     sprintf(names[ncols], "area2D.%u", g);
+            else                strcpy(names[ncols], "area2D");
+            cols[ncols++] = areas->area2D + g;
+        }
+    }
+    strcpy(names[ncols], "area2Dbox");
+    cols[ncols++] = areas->area2Dbox;
+
+    uint32_t byte_order = 0x01020304, version = 1, real_size = sizeof(real), uflags = flags;
+    int64_t nframes = areas->nframes;
+    int32_t natoms = areas->natoms;
+    size_t len = sizeof(magic) + 4 * sizeof(uint32_t) + sizeof(nframes) + sizeof(natoms) 
+        + 2 * sizeof(uint32_t) + ncols * sizeof(names[0]) + sizeof(ngroups) + ngroups * sizeof(int32_t);
+    uint32_t header_size = (len + BINALIGN - 1) / BINALIGN * BINALIGN;
+
+    FILE *f = fopen(fname, "wb");
+    if(f == NULL) {
+        print_log("Could not open %s for writing\n", fname);
+        return;
+    }
+
+    fwrite(magic, sizeof(magic), 1, f);
+    fwrite(&byte_order, sizeof(byte_order), 1, f);
+    fwrite(&version, sizeof(version), 1, f);
+    fwrite(&header_size, sizeof(header_size), 1, f);
+    fwrite(&real_size, sizeof(real_size), 1, f);
+    fwrite(&nframes, sizeof(nframes), 1, f);
+    fwrite(&natoms, sizeof(natoms), 1, f);
+    fwrite(&uflags, sizeof(uflags), 1, f);
+    fwrite(&ncols, sizeof(ncols), 1, f);
+    fwrite(names, sizeof(names[0]), ncols, f);
+    fwrite(&ngroups, sizeof(ngroups), 1, f);
+    for(uint32_t g = 0; g < ngroups; ++g) {
+        int32_t n = areas->group_natoms && ngroups > 1 ? areas->group_natoms[g] : areas->natoms;
+        fwrite(&n, sizeof(n), 1, f);
+    }
+    for(size_t i = len; i < header_size; ++i) {
+        fputc(0, f);
+    }
+
+    for(uint32_t c = 0; c < ncols; ++c) {
+        if(ngroups == 1 || c == ncols - 1) {
+            fwrite(cols[c], sizeof(real), areas->nframes, f);
+        }
+        else {
+            for(int fr = 0; fr < areas->nframes; ++fr) {
+                fwrite(cols[c] + fr * ngroups, sizeof(real), 1, f);
+            }
+        }
+    }
+
+    if(ferror(f))
+        print_log("Error writing %s\n", fname);
+    fclose(f);
+    sfree(names);
+    sfree(cols);
+    print_log("Binary surface areas saved to %s\n", fname);
+}
+
+
 void free_tri_area(struct tri_area *areas) {
     if(areas->area)         sfree(areas->area);
     if(areas->area2D)       sfree(areas->area2D);
     if(areas->area2Dbox)    sfree(areas->area2Dbox);
+    if(areas->group_natoms) sfree(areas->group_natoms);
+}
+
+
+#ifdef GTA_MPI
+// Gathers the width values of each frame in *col on rank 0, where *col is replaced by the values of all frames in order.
+// The frames of rank r come right after those of rank r - 1. counts and displs are only used on rank 0.
+static void gather_frames(real **col, int width, int nframes, int rank, int nranks, int total, 
+                          const int *rank_nframes, int *counts, int *displs) {
+    MPI_Datatype type = sizeof(real) == sizeof(double) ? MPI_DOUBLE : MPI_FLOAT;
+    real *all = NULL;
+
+    if(rank == 0) {
+        for(int r = 0; r < nranks; ++r) {
+            counts[r] = rank_nframes[r] * width;
+            displs[r] = r > 0 ? displs[r-1] + counts[r-1] : 0;
+        }
+        snew(all, total * width);
+    }
+    MPI_Gatherv(*col, nframes * width, type, all, counts, displs, type, 0, MPI_COMM_WORLD);
+
+    if(rank == 0) {
+        sfree(*col);
+        *col = all;
+    }
+}
+
+void gather_tri_area(struct tri_area *areas) {
+    int rank, nranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+    int *rank_nframes = NULL, *counts = NULL, *displs = NULL;
+    snew(rank_nframes, nranks);
+    snew(counts, nranks);
+    snew(displs, nranks);
+    MPI_Gather(&(areas->nframes), 1, MPI_INT, rank_nframes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    int total = 0;
+    for(int r = 0; r < nranks; ++r)  total += rank_nframes[r];
+
+    int ngroups = areas->ngroups > 1 ? areas->ngroups : 1;
+    gather_frames(&(areas->area), ngroups, areas->nframes, rank, nranks, total, rank_nframes, counts, displs);
+    if(areas->area2D)
+        gather_frames(&(areas->area2D), ngroups, areas->nframes, rank, nranks, total, rank_nframes, counts, displs);
+    gather_frames(&(areas->area2Dbox), 1, areas->nframes, rank, nranks, total, rank_nframes, counts, displs);
+
+    if(rank == 0) {
+        areas->nframes = total;
+        print_log("Gathered %d frames from %d ranks.\n", total, nranks);
+    }
+    sfree(rank_nframes);
+    sfree(counts);
+    sfree(displs);
+}
+#endif
+
+
+void gta_options_init(struct gta_options *opt) {
+    opt->flags = 0;
+    opt->espace = 0.8;
+    opt->nthreads = 0;
+    opt->schedule = GTA_SCHED_STATIC;
+    opt->chunk = 0;
+}
+
+
+struct gta_context *gta_context_new(const struct gta_options *opt) {
+    struct gta_context *ctx;
+    snew(ctx, 1);
+    ctx->opt = *opt;
+    dtinit(); // Initialize the delaunay triangulator
+    return ctx;
+}
+
+
+void gta_context_free(struct gta_context *ctx) {
+    for(int t = 0; t < ctx->nws; ++t) {
+        if(ctx->ws[t])  gta_ws_free(ctx->ws[t]);
+    }
+    sfree(ctx->ws);
+    sfree(ctx);
+}
+
+
+// Tessellates one frame of a caller's buffer with the workspace ws of ctx
+static void library_frame_area(struct gta_context *ctx, 
+                               struct gta_workspace *ws, 
+                               const float *xyz, 
+                               int natoms, 
+                               size_t stride, 
+                               const float *box9, 
+                               int frame, 
+                               double *a2Dbox, 
+                               double *a2D, 
+                               double *a3D) {
+    matrix box;
+    real r2Dbox, r2D = 0, r3D = 0;
+
+    for(int d = 0; d < DIM; ++d) {
+        for(int e = 0; e < DIM; ++e)
+            box[d][e] = box9[DIM * d + e];
+    }
+
+    tessellate_frame(frame_coords(ws, xyz, natoms, stride), box, natoms, ctx->opt.espace, ctx->opt.flags, 
+        frame, 0, ws, &r2Dbox, a2D ? &r2D : NULL, a3D ? &r3D : NULL);
+
+    if(a2Dbox)  *a2Dbox = r2Dbox;
+    if(a2D)     *a2D = r2D;
+    if(a3D)     *a3D = r3D;
+}
+
+
+int gta_frame_area(struct gta_context *ctx, 
+                   const float *xyz, 
+                   size_t natoms, 
+                   size_t stride, 
+                   const float box[9], 
+                   int frame, 
+                   double *a2Dbox, 
+                   double *a2D, 
+                   double *a3D) {
+    if(natoms < 3 || natoms > INT_MAX / 4 || stride < DIM)
+        return -1;
+
+    if(ctx->nws == 0)
+        context_threads(ctx);
+    // a single call always runs in the calling thread, so it gets the first workspace
+    if(ctx->ws[0] == NULL)
+        ctx->ws[0] = gta_ws_new();
+
+    library_frame_area(ctx, ctx->ws[0], xyz, natoms, stride, box, frame, a2Dbox, a2D, a3D);
+    return 0;
+}
+
+
+int gta_frames_area(struct gta_context *ctx, 
+                    const float *xyz, 
+                    size_t nframes, 
+                    size_t natoms, 
+                    size_t stride, 
+                    size_t frame_stride, 
+                    const float *box, 
+                    double *a2Dbox, 
+                    double *a2D, 
+                    double *a3D) {
+    if(natoms < 3 || natoms > INT_MAX / 4 || stride < DIM || nframes > INT_MAX)
+        return -1;
+
+    int nthreads = context_threads(ctx);
+
+#ifdef _OPENMP
+    // schedule(runtime) reads the schedule of the calling thread, which belongs to the caller
+    omp_sched_t caller_kind;
+    int caller_chunk;
+    omp_get_schedule(&caller_kind, &caller_chunk);
+#else
+    (void)nthreads; // only sizes the team
+#endif
+    set_schedule(&ctx->opt);
+
+#pragma omp parallel num_threads(nthreads) shared(ctx,xyz,box,a2Dbox,a2D,a3D)
+    {
+        struct gta_workspace *ws = context_ws(ctx);
+
+#pragma omp for schedule(runtime)
+        for(int fr = 0; fr < (int)nframes; ++fr) {
+            library_frame_area(ctx, ws, xyz + fr * frame_stride, natoms, stride, box + 9 * fr, fr, 
+                a2Dbox ? &a2Dbox[fr] : NULL, a2D ? &a2D[fr] : NULL, a3D ? &a3D[fr] : NULL);
+        }
+    }
+
+#ifdef _OPENMP
+    omp_set_schedule(caller_kind, caller_chunk);
+#endif
+    return 0;
 }
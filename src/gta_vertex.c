@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016 Ahnaf Siddiqui and Sameer Varma
+ */
+
+#define _POSIX_C_SOURCE 200809L // pwrite
+
+#include "gta_vertex.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "gkut_log.h"
+#include "smalloc.h"
+
+#define HEADERALIGN 64 // Alignment of the first frame
+
+
+struct gta_vertex_writer {
+    int fd;
+    char *fname;
+    int natoms, ngroups;
+    int *group_natoms; // [ngroups]
+    int *group_start; // [ngroups] offset of the atoms of each group in a frame
+    uint32_t header_size;
+    int failed; // a write failed, which is only reported once
+};
+
+
+// Writes all of buf at offset, as pwrite may write less than asked for
+static int write_at(int fd, const void *buf, size_t size, off_t offset) {
+    const char *p = buf;
+    while(size > 0) {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if(n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+struct gta_vertex_writer *open_vertex_writer(const char *fname, int natoms, int ngroups, const int *group_natoms) {
+    int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        print_log("Could not open %s for writing\n", fname);
+        return NULL;
+    }
+
+    struct gta_vertex_writer *w;
+    snew(w, 1);
+    w->fd = fd;
+    snew(w->fname, strlen(fname) + 1);
+    strcpy(w->fname, fname);
+    w->natoms = natoms;
+    w->ngroups = ngroups > 1 ? ngroups : 1;
+    snew(w->group_natoms, w->ngroups);
+    snew(w->group_start, w->ngroups);
+    for(int g = 0; g < w->ngroups; ++g) {
+        w->group_natoms[g] = ngroups > 1 ? group_natoms[g] : natoms;
+        w->group_start[g] = g > 0 ? w->group_start[g-1] + w->group_natoms[g-1] : 0;
+    }
+
+    size_t len = 8 + 4 * sizeof(uint32_t) + sizeof(int64_t) + sizeof(int32_t) + sizeof(uint32_t)
+        + w->ngroups * sizeof(int32_t);
+    w->header_size = (len + HEADERALIGN - 1) / HEADERALIGN * HEADERALIGN;
+    return w;
+}
+
+void write_vertex_areas(struct gta_vertex_writer *w, int frame, int group, const float *area) {
+    off_t offset = w->header_size + ((off_t)frame * w->natoms + w->group_start[group]) * sizeof(float);
+    if(write_at(w->fd, area, w->group_natoms[group] * sizeof(float), offset) != 0)
+        w->failed = 1; // benign race, any thread may set it
+}
+
+void close_vertex_writer(struct gta_vertex_writer *w, int nframes) {
+    unsigned char *header;
+    snew(header, w->header_size); // zero padding included
+
+    const char magic[8] = "GTAVERT";
+    uint32_t u[4] = {0x01020304, 1, w->header_size, sizeof(float)}; // byte order, version, header size, value size
+    int64_t n = nframes;
+    int32_t natoms = w->natoms;
+    uint32_t ngroups = w->ngroups;
+
+    unsigned char *p = header;
+    memcpy(p, magic, sizeof(magic));        p += sizeof(magic);
+    memcpy(p, u, sizeof(u));                p += sizeof(u);
+    memcpy(p, &n, sizeof(n));               p += sizeof(n);
+    memcpy(p, &natoms, sizeof(natoms));     p += sizeof(natoms);
+    memcpy(p, &ngroups, sizeof(ngroups));   p += sizeof(ngroups);
+    for(int g = 0; g < w->ngroups; ++g) {
+        int32_t gn = w->group_natoms[g];
+        memcpy(p, &gn, sizeof(gn));         p += sizeof(gn);
+    }
+
+    if(write_at(w->fd, header, w->header_size, 0) != 0)
+        w->failed = 1;
+    if(close(w->fd) != 0)
+        w->failed = 1;
+
+    if(w->failed)
+        print_log("Error writing %s\n", w->fname);
+    else
+        print_log("Areas of %d atoms in %d frames saved to %s\n", w->natoms, nframes, w->fname);
+
+    sfree(header);
+    sfree(w->fname);
+    sfree(w->group_natoms);
+    sfree(w->group_start);
+    sfree(w);
+}